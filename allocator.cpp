@@ -0,0 +1,94 @@
+#include "include/allocator.h"
+#include "include/memory.h"
+#include "include/buddy.h"
+#include <stdexcept>
+
+static const char *NAMES[] = {"buddy", "first_fit", "best_fit", "worst_fit"};
+
+const char *allocator_name(AllocatorKind kind) { return NAMES[(int)kind]; }
+
+AllocatorKind parse_allocator(const std::string &name)
+{
+    for (int k = 0; k < 4; k++)
+        if (name == NAMES[k])
+            return (AllocatorKind)k;
+    throw std::invalid_argument("allocator: expected buddy, first_fit, best_fit or worst_fit, got '" + name + "'");
+}
+
+/* ---------------- BUDDY ---------------- */
+
+class BuddyBackend : public Allocator {
+private:
+    BuddyAllocator buddy;
+    size_t memory;
+
+public:
+    BuddyBackend(size_t mem, size_t min_block) : buddy(mem, min_block), memory(mem) {}
+
+    AllocatorKind kind() const override { return AllocatorKind::BUDDY; }
+
+    bool allocate(size_t size, size_t &handle) override
+    {
+        try {
+            handle = buddy.allocate(size);
+        } catch (const std::runtime_error &) {
+            return false; // out of memory
+        }
+        return true;
+    }
+    void deallocate(size_t handle) override { buddy.deallocate(handle); }
+
+    size_t capacity() const override { return memory; }
+    size_t free_size() const override { return buddy.free_size(); }
+    size_t largest_free_block() const override { return buddy.largest_free_block(); }
+
+    void register_stats(StatsRegistry &stats, const std::string &prefix) const override { buddy.register_stats(stats, prefix); }
+    void checkpoint(CheckpointWriter &out) const override { buddy.checkpoint(out); }
+    void restore(CheckpointReader &in) override { buddy.restore(in); }
+};
+
+/* ---------------- CONTIGUOUS ---------------- */
+
+class FitBackend : public Allocator {
+private:
+    PhysicalMemory heap;
+    size_t memory;
+    AllocatorKind fit;
+
+public:
+    FitBackend(size_t mem, AllocatorKind k) : heap(mem), memory(mem), fit(k) {}
+
+    AllocatorKind kind() const override { return fit; }
+
+    bool allocate(size_t size, size_t &handle) override
+    {
+        int id = fit == AllocatorKind::FIRST_FIT ? heap.allocate_first_fit(size)
+               : fit == AllocatorKind::BEST_FIT  ? heap.allocate_best_fit(size)
+                                                 : heap.allocate_worst_fit(size);
+        if (id < 0)
+            return false;
+        handle = (size_t)id;
+        return true;
+    }
+    void deallocate(size_t handle) override { heap.deallocate((int)handle); }
+
+    size_t capacity() const override { return memory; }
+    size_t free_size() const override { return heap.free_size(); }
+    size_t largest_free_block() const override { return heap.largest_free_block(); }
+
+    void register_stats(StatsRegistry &stats, const std::string &prefix) const override { heap.register_stats(stats, prefix); }
+    void checkpoint(CheckpointWriter &out) const override { heap.checkpoint(out); }
+    void restore(CheckpointReader &in) override { heap.restore(in); }
+};
+
+std::unique_ptr<Allocator> make_allocator(AllocatorKind kind, size_t memory, size_t min_block)
+{
+    if (kind == AllocatorKind::BUDDY) {
+        if (min_block == 0 || memory < min_block)
+            throw std::invalid_argument("memory must hold at least one min_block");
+        return std::unique_ptr<Allocator>(new BuddyBackend(memory, min_block));
+    }
+    if (memory == 0)
+        throw std::invalid_argument("memory must not be 0");
+    return std::unique_ptr<Allocator>(new FitBackend(memory, kind));
+}
@@ -0,0 +1,172 @@
+#include "include/backing_store.h"
+#include "include/checkpoint.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SWAP_FILE_SUPPORTED
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+BackingStore::BackingStore(size_t psize)
+    : page_size(psize),
+      fd(-1),
+      mapping(nullptr),
+      capacity(0)
+{
+}
+
+BackingStore::~BackingStore()
+{
+#ifdef SWAP_FILE_SUPPORTED
+    if (mapping)
+        munmap(mapping, capacity * page_size);
+    if (fd != -1)
+        close(fd);
+#endif
+}
+
+void BackingStore::use_file(const std::string &file)
+{
+    if (!slots.empty())
+        throw std::runtime_error("Swap file must be set before anything is swapped out");
+#ifdef SWAP_FILE_SUPPORTED
+    int new_fd = open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (new_fd == -1)
+        throw std::runtime_error("Cannot open swap file " + file);
+    if (fd != -1)
+    {
+        munmap(mapping, capacity * page_size);
+        close(fd);
+    }
+    fd = new_fd;
+    mapping = nullptr;
+    capacity = 0;
+    path = file;
+    grow_file(64);
+#else
+    throw std::runtime_error("Swap files need mmap, not available on this platform");
+#endif
+}
+
+// the file is only ftruncate'd, so untouched slots never take disk space
+void BackingStore::grow_file(size_t min_slots)
+{
+#ifdef SWAP_FILE_SUPPORTED
+    size_t new_capacity = capacity == 0 ? min_slots : capacity;
+    while (new_capacity < min_slots)
+        new_capacity *= 2;
+    if (ftruncate(fd, (off_t)(new_capacity * page_size)) != 0)
+        throw std::runtime_error("Cannot grow swap file " + path);
+    if (mapping)
+        munmap(mapping, capacity * page_size);
+    void *m = mmap(nullptr, new_capacity * page_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED)
+        throw std::runtime_error("Cannot map swap file " + path);
+    mapping = static_cast<uint8_t *>(m);
+    capacity = new_capacity;
+#else
+    (void)min_slots;
+#endif
+}
+
+uint8_t *BackingStore::slot_data(size_t slot)
+{
+    if (path.empty())
+        return memory_slots[slot].data();
+    return mapping + slot * page_size;
+}
+
+void BackingStore::write(int pid, uint64_t vpn, const uint8_t *data)
+{
+    auto it = slots.find({pid, vpn});
+    size_t slot;
+    if (it != slots.end())
+    {
+        slot = it->second;
+    }
+    else
+    {
+        // first time this page goes out: materialise a slot for it
+        slot = slots.size();
+        if (path.empty())
+            memory_slots.emplace_back(page_size);
+        else if (slot >= capacity)
+            grow_file(slot + 1);
+        slots[{pid, vpn}] = slot;
+    }
+    std::memcpy(slot_data(slot), data, page_size);
+}
+
+void BackingStore::copy_process(int from, int to)
+{
+    std::vector<std::pair<uint64_t, size_t>> owned;
+    for (auto &s : slots)
+        if (s.first.pid == from)
+            owned.push_back({s.first.vpn, s.second});
+    // write() may remap the file, so go through a copy of the page
+    std::vector<uint8_t> page(page_size);
+    for (auto &o : owned)
+    {
+        std::memcpy(page.data(), slot_data(o.second), page_size);
+        write(to, o.first, page.data());
+    }
+}
+
+bool BackingStore::read(int pid, uint64_t vpn, uint8_t *data)
+{
+    auto it = slots.find({pid, vpn});
+    if (it == slots.end())
+    {
+        std::memset(data, 0, page_size);
+        return false;
+    }
+    std::memcpy(data, slot_data(it->second), page_size);
+    return true;
+}
+
+static bool zero_page(const uint8_t *data, size_t n)
+{
+    return std::all_of(data, data + n, [](uint8_t b) { return b == 0; });
+}
+
+void BackingStore::checkpoint(CheckpointWriter &out)
+{
+    std::vector<SwapKey> order(slots.size());
+    for (auto &s : slots)
+        order[s.second] = s.first;
+    out.put(order.size());
+    for (const SwapKey &k : order)
+    {
+        const uint8_t *data = slot_data(slots[k]);
+        bool zero = zero_page(data, page_size);
+        out.put_signed(k.pid);
+        out.put(k.vpn);
+        out.put_bool(zero);
+        if (!zero)
+            out.put_bytes(data, page_size);
+    }
+}
+
+void BackingStore::restore(CheckpointReader &in)
+{
+    if (!slots.empty())
+        throw std::runtime_error("Swap space must be empty to restore a checkpoint");
+    uint64_t n = in.get();
+    std::vector<uint8_t> page(page_size);
+    for (uint64_t i = 0; i < n; i++)
+    {
+        int pid = (int)in.get_signed();
+        uint64_t vpn = in.get();
+        if (slots.count({pid, vpn}))
+            throw std::runtime_error("Checkpoint holds a swap slot twice");
+        if (in.get_bool())
+            std::fill(page.begin(), page.end(), 0);
+        else
+            in.get_bytes(page.data(), page_size);
+        write(pid, vpn, page.data());
+    }
+}
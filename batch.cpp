@@ -0,0 +1,998 @@
+#include "include/batch.h"
+#include "include/sweep.h"
+#include "include/event_trace.h"
+#include "include/checkpoint.h"
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <algorithm>
+#include <vector>
+#include <unordered_map>
+#include <chrono>
+#include <thread>
+#include <stdexcept>
+
+/* ---------------- CONFIGURATION ---------------- */
+
+BatchConfig default_batch_config()
+{
+    BatchConfig c;
+    c.mode = BatchMode::CACHE;
+    c.block_size = 64;
+    c.cache_size[0] = 32 * 1024;
+    c.cache_size[1] = 256 * 1024;
+    c.cache_size[2] = 2 * 1024 * 1024;
+    c.cache_ways[0] = 4;
+    c.cache_ways[1] = 8;
+    c.cache_ways[2] = 16;
+    c.cache_latency[0] = 1;
+    c.cache_latency[1] = 5;
+    c.cache_latency[2] = 20;
+    c.cache_victim[0] = c.cache_victim[1] = c.cache_victim[2] = 0;
+    c.cache_policy = ReplacementPolicy::LRU;
+    c.ram_latency = 100;
+    c.dram = false;
+    c.dram_config = default_dram_config();
+
+    c.processes = 1;
+    c.pages = 1 << 20;
+    c.frames = 1024;
+    c.page_size = 4096;
+    c.policy = PageReplacement::CLOCK;
+    c.tlb = true;
+    c.readahead = 0;
+    c.thp = false;
+    c.numa_nodes = 0;
+    c.numa_local = 100;
+    c.numa_remote = 200;
+    c.numa_migrate = 0;
+
+    c.allocator = AllocatorKind::BUDDY;
+    c.memory = 1 << 20;
+    c.min_block = 16;
+
+    c.workload = BatchWorkload::TRACE;
+    c.addresses = default_address_workload();
+    c.allocations = default_allocation_workload();
+    c.restore = "";
+    c.checkpoint = "";
+    return c;
+}
+
+static uint64_t to_number(const std::string &key, const std::string &value)
+{
+    size_t used = 0;
+    uint64_t v = 0;
+    try {
+        v = std::stoull(value, &used, 0); // decimal or 0x hex
+    } catch (const std::exception &) {
+        used = 0;
+    }
+    if (used == 0 || used != value.size() || value[0] == '-')
+        throw std::invalid_argument(key + ": expected a number, got '" + value + "'");
+    return v;
+}
+
+static double to_real(const std::string &key, const std::string &value)
+{
+    size_t used = 0;
+    double v = 0;
+    try {
+        v = std::stod(value, &used);
+    } catch (const std::exception &) {
+        used = 0;
+    }
+    if (used == 0 || used != value.size())
+        throw std::invalid_argument(key + ": expected a number, got '" + value + "'");
+    return v;
+}
+
+static AddressPattern to_pattern(const std::string &value)
+{
+    if (value == "sequential")
+        return AddressPattern::SEQUENTIAL;
+    if (value == "strided")
+        return AddressPattern::STRIDED;
+    if (value == "uniform")
+        return AddressPattern::UNIFORM;
+    if (value == "zipf")
+        return AddressPattern::ZIPF;
+    if (value == "chase")
+        return AddressPattern::POINTER_CHASE;
+    if (value == "phased")
+        return AddressPattern::PHASED;
+    throw std::invalid_argument("workload: expected trace, sequential, strided, uniform, zipf, chase, phased or alloc");
+}
+
+static bool to_switch(const std::string &key, const std::string &value)
+{
+    if (value != "on" && value != "off")
+        throw std::invalid_argument(key + ": expected on or off, got '" + value + "'");
+    return value == "on";
+}
+
+void set_option(BatchConfig &c, const std::string &key, const std::string &value)
+{
+    // l1_size, l2_ways, l3_latency, ...
+    if (key.size() > 3 && key[0] == 'l' && key[1] >= '1' && key[1] <= '3' && key[2] == '_') {
+        int level = key[1] - '1';
+        std::string what = key.substr(3);
+        if (what == "size")
+            c.cache_size[level] = to_number(key, value);
+        else if (what == "ways")
+            c.cache_ways[level] = to_number(key, value);
+        else if (what == "latency")
+            c.cache_latency[level] = to_number(key, value);
+        else if (what == "victim")
+            c.cache_victim[level] = to_number(key, value);
+        else
+            throw std::invalid_argument("Unknown option " + key);
+    }
+    else if (key == "mode") {
+        if (value != "cache" && value != "vm" && value != "alloc")
+            throw std::invalid_argument("mode: expected cache, vm or alloc");
+        c.mode = value == "cache" ? BatchMode::CACHE
+               : value == "vm"    ? BatchMode::VM
+                                  : BatchMode::ALLOC;
+    }
+    else if (key == "block")
+        c.block_size = to_number(key, value);
+    else if (key == "cache_policy") {
+        if (value != "fifo" && value != "lru" && value != "lfu" && value != "adaptive")
+            throw std::invalid_argument("cache_policy: expected fifo, lru, lfu or adaptive");
+        c.cache_policy = value == "fifo" ? ReplacementPolicy::FIFO
+                       : value == "lru"  ? ReplacementPolicy::LRU
+                       : value == "lfu"  ? ReplacementPolicy::LFU
+                                         : ReplacementPolicy::ADAPTIVE;
+    }
+    else if (key == "ram_latency")
+        c.ram_latency = to_number(key, value);
+    else if (key == "dram")
+        c.dram = to_switch(key, value);
+    else if (key == "dram_channels")
+        c.dram_config.channels = to_number(key, value);
+    else if (key == "dram_ranks")
+        c.dram_config.ranks = to_number(key, value);
+    else if (key == "dram_banks")
+        c.dram_config.banks = to_number(key, value);
+    else if (key == "dram_row")
+        c.dram_config.row_bytes = to_number(key, value);
+    else if (key == "dram_tcas")
+        c.dram_config.t_cas = to_number(key, value);
+    else if (key == "dram_trcd")
+        c.dram_config.t_rcd = to_number(key, value);
+    else if (key == "dram_trp")
+        c.dram_config.t_rp = to_number(key, value);
+    else if (key == "dram_burst")
+        c.dram_config.t_burst = to_number(key, value);
+    else if (key == "dram_page") {
+        if (value != "open" && value != "closed")
+            throw std::invalid_argument("dram_page: expected open or closed");
+        c.dram_config.page_policy = value == "open" ? DramPagePolicy::OPEN : DramPagePolicy::CLOSED;
+    }
+    else if (key == "dram_sched") {
+        if (value != "fcfs" && value != "frfcfs")
+            throw std::invalid_argument("dram_sched: expected fcfs or frfcfs");
+        c.dram_config.scheduler = value == "fcfs" ? DramScheduler::FCFS : DramScheduler::FR_FCFS;
+    }
+    else if (key == "processes")
+        c.processes = to_number(key, value);
+    else if (key == "pages")
+        c.pages = to_number(key, value);
+    else if (key == "frames")
+        c.frames = to_number(key, value);
+    else if (key == "page_size")
+        c.page_size = to_number(key, value);
+    else if (key == "policy") {
+        if (value == "fifo")
+            c.policy = PageReplacement::FIFO;
+        else if (value == "lru")
+            c.policy = PageReplacement::LRU;
+        else if (value == "clock")
+            c.policy = PageReplacement::CLOCK;
+        else if (value == "aging")
+            c.policy = PageReplacement::AGING;
+        else if (value == "wsclock")
+            c.policy = PageReplacement::WSCLOCK;
+        else if (value == "opt")
+            c.policy = PageReplacement::OPT;
+        else
+            throw std::invalid_argument("policy: expected fifo, lru, clock, aging, wsclock or opt");
+    }
+    else if (key == "tlb")
+        c.tlb = to_switch(key, value);
+    else if (key == "readahead")
+        c.readahead = to_number(key, value);
+    else if (key == "thp")
+        c.thp = to_switch(key, value);
+    else if (key == "numa_nodes")
+        c.numa_nodes = to_number(key, value);
+    else if (key == "numa_local")
+        c.numa_local = to_number(key, value);
+    else if (key == "numa_remote")
+        c.numa_remote = to_number(key, value);
+    else if (key == "numa_migrate")
+        c.numa_migrate = to_number(key, value);
+    else if (key == "allocator")
+        c.allocator = parse_allocator(value);
+    else if (key == "memory")
+        c.memory = to_number(key, value);
+    else if (key == "min_block")
+        c.min_block = to_number(key, value);
+    else if (key == "workload") {
+        if (value == "trace")
+            c.workload = BatchWorkload::TRACE;
+        else if (value == "alloc")
+            c.workload = BatchWorkload::ALLOCATIONS;
+        else {
+            c.addresses.pattern = to_pattern(value);
+            c.workload = BatchWorkload::ADDRESSES;
+        }
+    }
+    else if (key == "count")
+        c.addresses.count = c.allocations.count = to_number(key, value);
+    else if (key == "seed")
+        c.addresses.seed = c.allocations.seed = to_number(key, value);
+    else if (key == "footprint")
+        c.addresses.footprint = to_number(key, value);
+    else if (key == "stride")
+        c.addresses.stride = to_number(key, value);
+    else if (key == "zipf_theta")
+        c.addresses.zipf_theta = to_real(key, value);
+    else if (key == "hot_bytes")
+        c.addresses.hot_bytes = to_number(key, value);
+    else if (key == "phase_length")
+        c.addresses.phase_length = to_number(key, value);
+    else if (key == "write_ratio")
+        c.addresses.write_ratio = to_real(key, value);
+    else if (key == "sizes") {
+        if (value == "fixed")
+            c.allocations.sizes = SizeDistribution::FIXED;
+        else if (value == "uniform")
+            c.allocations.sizes = SizeDistribution::UNIFORM;
+        else if (value == "exponential")
+            c.allocations.sizes = SizeDistribution::EXPONENTIAL;
+        else if (value == "bimodal")
+            c.allocations.sizes = SizeDistribution::BIMODAL;
+        else
+            throw std::invalid_argument("sizes: expected fixed, uniform, exponential or bimodal");
+    }
+    else if (key == "min_size" || key == "max_size") {
+        uint64_t v = to_number(key, value);
+        if (v > UINT32_MAX)
+            throw std::invalid_argument(key + ": at most " + std::to_string(UINT32_MAX));
+        (key == "min_size" ? c.allocations.min_size : c.allocations.max_size) = (uint32_t)v;
+    }
+    else if (key == "mean_size")
+        c.allocations.mean_size = to_real(key, value);
+    else if (key == "lifetime") {
+        if (value == "fifo")
+            c.allocations.lifetime = LifetimeModel::FIFO;
+        else if (value == "lifo")
+            c.allocations.lifetime = LifetimeModel::LIFO;
+        else if (value == "random")
+            c.allocations.lifetime = LifetimeModel::RANDOM;
+        else if (value == "exponential")
+            c.allocations.lifetime = LifetimeModel::EXPONENTIAL;
+        else
+            throw std::invalid_argument("lifetime: expected fifo, lifo, random or exponential");
+    }
+    else if (key == "live")
+        c.allocations.live = to_number(key, value);
+    else if (key == "mean_lifetime")
+        c.allocations.mean_lifetime = to_real(key, value);
+    else if (key == "restore")
+        c.restore = value;
+    else if (key == "checkpoint")
+        c.checkpoint = value;
+    else
+        throw std::invalid_argument("Unknown option " + key);
+}
+
+static std::string trim(const std::string &s)
+{
+    size_t b = s.find_first_not_of(" \t\r");
+    if (b == std::string::npos)
+        return "";
+    return s.substr(b, s.find_last_not_of(" \t\r") - b + 1);
+}
+
+// key = value per line, '#' comments
+void load_config(BatchConfig &c, const std::string &path)
+{
+    std::ifstream in(path);
+    if (!in)
+        throw std::runtime_error("Cannot open config " + path);
+    std::string line;
+    for (size_t n = 1; std::getline(in, line); n++) {
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty())
+            continue;
+        size_t eq = line.find('=');
+        if (eq == std::string::npos)
+            throw std::invalid_argument(path + ":" + std::to_string(n) + ": expected key = value");
+        try {
+            set_option(c, trim(line.substr(0, eq)), trim(line.substr(eq + 1)));
+        } catch (const std::invalid_argument &e) {
+            throw std::invalid_argument(path + ":" + std::to_string(n) + ": " + e.what());
+        }
+    }
+}
+
+/* ---------------- REPLAY ---------------- */
+
+static void snapshot(StatsRegistry &registry, StatsOutput &out)
+{
+    if (out.json)
+        registry.write_json(*out.out);
+    else
+        registry.write_csv(*out.out);
+}
+
+struct LiveBlock {
+    size_t handle;
+    uint64_t requested;
+    uint64_t block;
+};
+
+// one allocator replaying an allocation trace
+struct AllocatorReplay {
+    std::unique_ptr<Allocator> allocator;
+    std::unordered_map<uint64_t, LiveBlock> live; // allocation id -> block
+    BatchResult r;
+    uint64_t alloc_ticks; // host time inside allocate / deallocate
+    uint64_t free_ticks;
+};
+
+static AllocatorReplay make_replay(AllocatorKind kind, const BatchConfig &cfg)
+{
+    AllocatorReplay a;
+    a.allocator = make_allocator(kind, cfg.memory, cfg.min_block);
+    a.r = {};
+    a.alloc_ticks = a.free_ticks = 0;
+    return a;
+}
+
+// alloc <id> <bytes> / free <id>, n = number of the record
+static void replay_record(AllocatorReplay &a, const TraceRecord &rec, uint64_t n)
+{
+    BatchResult &r = a.r;
+    if (rec.op == TraceOp::ALLOC) {
+        if (a.live.count(rec.addr))
+            throw std::runtime_error("Record " + std::to_string(n) + ": allocation " + std::to_string(rec.addr) +
+                                     " is still live");
+        size_t before = a.allocator->free_size();
+        size_t handle;
+        uint64_t t0 = host_ticks();
+        bool ok = a.allocator->allocate(rec.size, handle);
+        a.alloc_ticks += host_ticks() - t0;
+        r.references++;
+        if (!ok) {
+            r.alloc_failures++; // out of memory, the program would see NULL
+            return;
+        }
+        uint64_t block = before - a.allocator->free_size();
+        a.live[rec.addr] = {handle, rec.size, block};
+        r.allocations++;
+        r.requested_bytes += rec.size;
+        r.allocated_bytes += block;
+        r.peak_bytes = std::max(r.peak_bytes, r.allocated_bytes);
+    }
+    else if (rec.op == TraceOp::FREE) {
+        auto it = a.live.find(rec.addr);
+        if (it == a.live.end()) {
+            r.skipped++; // free of a failed (or never made) allocation
+            return;
+        }
+        uint64_t t0 = host_ticks();
+        a.allocator->deallocate(it->second.handle);
+        a.free_ticks += host_ticks() - t0;
+        r.requested_bytes -= it->second.requested;
+        r.allocated_bytes -= it->second.block;
+        a.live.erase(it);
+        r.frees++;
+        r.references++;
+    }
+    else {
+        r.skipped++;
+        r.references++;
+    }
+}
+
+static BatchResult run_allocator(const BatchConfig &cfg, TraceSource &trace, StatsOutput *stats)
+{
+    AllocatorReplay a = make_replay(cfg.allocator, cfg);
+    BatchResult &r = a.r;
+    TraceRecord rec;
+    uint64_t n = 0;
+
+    // the allocator and the live allocations of a previous run, the counters start from 0
+    if (!cfg.restore.empty()) {
+        CheckpointReader in(cfg.restore);
+        a.allocator->restore(in);
+        in.begin("LIVE");
+        uint64_t count = in.get_below(cfg.memory + 1, "allocation count");
+        for (uint64_t i = 0; i < count; i++) {
+            uint64_t id = in.get();
+            LiveBlock &b = a.live[id];
+            b.handle = in.get();
+            b.requested = in.get();
+            b.block = in.get();
+            r.requested_bytes += b.requested;
+            r.allocated_bytes += b.block;
+        }
+        in.end();
+        if (!in.done())
+            throw std::runtime_error(cfg.restore + ": checkpoint of another mode");
+        r.peak_bytes = r.allocated_bytes;
+    }
+
+    StatsRegistry registry;
+    if (stats) {
+        registry.counter("replay.records", &n);
+        registry.counter("replay.allocations", &r.allocations);
+        registry.counter("replay.alloc_failures", &r.alloc_failures);
+        registry.counter("replay.frees", &r.frees);
+        registry.counter("replay.requested_bytes", &r.requested_bytes);
+        registry.counter("replay.allocated_bytes", &r.allocated_bytes);
+        a.allocator->register_stats(registry, cfg.allocator == AllocatorKind::BUDDY ? "buddy" : "memory");
+        if (profile_compiled())
+            register_profile(registry, "host");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    while (trace.next(rec)) {
+        if (stats && stats->every && n && n % stats->every == 0)
+            snapshot(registry, *stats); // the previous n records
+        replay_record(a, rec, ++n);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    r.seconds = elapsed.count();
+    r.free_bytes = a.allocator->free_size();
+    r.largest_free = a.allocator->largest_free_block();
+    if (stats)
+        snapshot(registry, *stats);
+
+    if (!cfg.checkpoint.empty()) {
+        CheckpointWriter out;
+        a.allocator->checkpoint(out);
+        out.begin("LIVE");
+        out.put(a.live.size());
+        for (const auto &b : a.live) {
+            out.put(b.first);
+            out.put(b.second.handle);
+            out.put(b.second.requested);
+            out.put(b.second.block);
+        }
+        out.end();
+        out.save(cfg.checkpoint);
+    }
+    return r;
+}
+
+static double ratio(uint64_t part, uint64_t whole) { return whole ? (double)part / whole : 0.0; }
+
+static void compare_row(std::ostream &out, uint64_t record, AllocatorReplay &a, uint64_t &allocs, uint64_t &frees)
+{
+    const BatchResult &r = a.r;
+    size_t free = a.allocator->free_size();
+    size_t largest = a.allocator->largest_free_block();
+    double ns = 1e9 / host_ticks_per_second();
+    uint64_t new_allocs = r.allocations + r.alloc_failures - allocs;
+    uint64_t new_frees = r.frees - frees;
+    out << record << "," << allocator_name(a.allocator->kind()) << "," << r.requested_bytes << ","
+        << r.allocated_bytes << "," << free << "," << largest << ","
+        << ratio(r.requested_bytes, a.allocator->capacity()) << ","
+        << 1.0 - ratio(r.requested_bytes, r.allocated_bytes) << ","
+        << (free ? 1.0 - ratio(largest, free) : 0.0) << "," << r.allocations << "," << r.alloc_failures << ","
+        << r.frees << "," << (new_allocs ? a.alloc_ticks * ns / new_allocs : 0.0) << ","
+        << (new_frees ? a.free_ticks * ns / new_frees : 0.0) << "\n";
+    allocs += new_allocs;
+    frees += new_frees;
+    a.alloc_ticks = a.free_ticks = 0;
+}
+
+void compare_allocators(const BatchConfig &cfg, TraceSource &trace, const std::vector<AllocatorKind> &kinds,
+                        uint64_t every, std::ostream &out)
+{
+    if (!cfg.restore.empty() || !cfg.checkpoint.empty())
+        throw std::invalid_argument("checkpoint and restore need a single allocator");
+    std::vector<AllocatorReplay> replays;
+    for (AllocatorKind k : kinds)
+        replays.push_back(make_replay(k, cfg));
+    std::vector<uint64_t> allocs(kinds.size(), 0), frees(kinds.size(), 0); // operations in earlier rows
+
+    out << "record,allocator,requested_bytes,block_bytes,free_bytes,largest_free,utilization,"
+        << "internal_fragmentation,external_fragmentation,allocations,failures,frees,alloc_ns,free_ns\n";
+    TraceRecord rec;
+    uint64_t n = 0;
+    while (trace.next(rec)) {
+        n++;
+        for (AllocatorReplay &a : replays)
+            replay_record(a, rec, n);
+        if (every && n % every == 0)
+            for (size_t i = 0; i < replays.size(); i++)
+                compare_row(out, n, replays[i], allocs[i], frees[i]);
+    }
+    if (!(every && n && n % every == 0))
+        for (size_t i = 0; i < replays.size(); i++)
+            compare_row(out, n, replays[i], allocs[i], frees[i]);
+}
+
+std::unique_ptr<TraceSource> open_trace(const char *data, size_t size, const std::string &format, const BatchConfig &cfg)
+{
+    if (is_binary_trace(data, size))
+        return std::unique_ptr<TraceSource>(new BinaryTrace(data, size));
+    if (format == "lackey")
+        return std::unique_ptr<TraceSource>(new LackeyTrace(data, size));
+    return std::unique_ptr<TraceSource>(new TextTrace(data, size, cfg.mode == BatchMode::VM));
+}
+
+std::unique_ptr<TraceSource> make_workload(const BatchConfig &cfg)
+{
+    if (cfg.workload == BatchWorkload::ALLOCATIONS)
+        return std::unique_ptr<TraceSource>(new AllocationGenerator(cfg.allocations));
+    if (cfg.workload != BatchWorkload::ADDRESSES)
+        throw std::invalid_argument("No workload generator configured");
+    AddressWorkload w = cfg.addresses;
+    w.processes = cfg.mode == BatchMode::VM ? cfg.processes : 1;
+    return std::unique_ptr<TraceSource>(new AddressGenerator(w));
+}
+
+// VM counters reported by print_result
+static void vm_counters(const VirtualMemory &vm, BatchResult &r)
+{
+    r.page_hits = vm.page_hits;
+    r.page_faults = vm.page_faults;
+    r.major_faults = vm.major_faults;
+    r.writebacks = vm.writebacks;
+    if (vm.dtlb()) {
+        r.tlb_hits = vm.dtlb()->hits + vm.stlb()->hits;
+        r.tlb_misses = vm.stlb()->misses;
+    }
+    r.page_walks = vm.page_walks;
+    r.translation_cycles = vm.translation_cycles;
+    r.fault_cycles = vm.fault_cycles;
+}
+
+BatchResult run_trace(const BatchConfig &cfg, TraceSource &trace, StatsOutput *stats)
+{
+    if (cfg.mode == BatchMode::ALLOC)
+        return run_allocator(cfg, trace, stats);
+
+    BatchResult r = {};
+    Cache L1(cfg.cache_size[0], cfg.block_size, cfg.cache_ways[0], cfg.cache_policy, cfg.cache_latency[0]);
+    Cache L2(cfg.cache_size[1], cfg.block_size, cfg.cache_ways[1], cfg.cache_policy, cfg.cache_latency[1]);
+    Cache L3(cfg.cache_size[2], cfg.block_size, cfg.cache_ways[2], cfg.cache_policy, cfg.cache_latency[2]);
+    L1.event_unit = 1;
+    L2.event_unit = 2;
+    L3.event_unit = 3;
+    Cache *levels[3] = {&L1, &L2, &L3};
+    for (int i = 0; i < 3; i++)
+        levels[i]->set_victim_cache(cfg.cache_victim[i]);
+
+    std::unique_ptr<DramController> dram;
+    if (cfg.dram) {
+        DramConfig d = cfg.dram_config;
+        d.line_bytes = cfg.block_size;
+        dram.reset(new DramController(d));
+    }
+
+    std::unique_ptr<VirtualMemory> vm;
+    TraceRecord rec;
+    if (cfg.mode == BatchMode::VM) {
+        if (cfg.page_size == 0 || cfg.frames == 0)
+            throw std::invalid_argument("page_size and frames must not be 0");
+        vm.reset(new VirtualMemory(cfg.pages, cfg.frames, cfg.page_size, cfg.policy));
+        for (int pid = 0; pid < (int)cfg.processes; pid++)
+            vm->create_process(pid, cfg.pages);
+        if (cfg.tlb)
+            vm->configure_tlb({16, 4, ReplacementPolicy::LRU, 1, 1}, {128, 12, ReplacementPolicy::LRU, 7, 7}, true, 20);
+        if (cfg.readahead > 0)
+            vm->set_readahead(1, cfg.readahead);
+        vm->set_thp(cfg.thp);
+        if (cfg.numa_nodes > 0) {
+            vm->use_numa(cfg.numa_nodes, cfg.numa_local, cfg.numa_remote);
+            vm->set_numa_migration(cfg.numa_migrate, 2000);
+        }
+        if (cfg.policy == PageReplacement::OPT) {
+            // OPT needs the whole reference string up front
+            std::vector<SwapKey> refs;
+            while (trace.next(rec))
+                if (rec.is_access())
+                    refs.push_back({rec.pid, rec.addr / cfg.page_size});
+            vm->set_future(refs);
+            trace.rewind();
+        }
+    }
+
+    // caches and VM of a previous run (DRAM rows start closed); the result counts this run only
+    BatchResult warm = {};
+    if (!cfg.restore.empty()) {
+        CheckpointReader in(cfg.restore);
+        if (vm) {
+            vm->restore(in);
+            vm_counters(*vm, warm);
+        }
+        L1.restore(in);
+        L2.restore(in);
+        L3.restore(in);
+        if (!in.done())
+            throw std::runtime_error(cfg.restore + ": checkpoint of another mode");
+    }
+    uint64_t warm_victim_hits[3] = {L1.victim_hits, L2.victim_hits, L3.victim_hits};
+
+    // same charging as the interactive menus; fills are not counted as hits here
+    auto hierarchy = [&](uint64_t pa, int pid) {
+        r.total_cycles += L1.latency();
+        if (L1.access(pa)) {
+            r.cache_hits[0]++;
+            return;
+        }
+        r.cache_misses[0]++;
+        r.total_cycles += L2.latency();
+        if (L2.access(pa)) {
+            r.cache_hits[1]++;
+            L1.access(pa);
+            return;
+        }
+        r.cache_misses[1]++;
+        r.total_cycles += L3.latency();
+        if (L3.access(pa)) {
+            r.cache_hits[2]++;
+            L2.access(pa);
+            L1.access(pa);
+            return;
+        }
+        r.cache_misses[2]++;
+        r.ram_accesses++;
+
+        uint64_t ram_latency = dram ? dram->access(pa, r.total_cycles) : cfg.ram_latency;
+        if (vm && vm->numa_topology()) {
+            // the node latency replaces the flat cost, with DRAM only the remote hop is added
+            int home = vm->process(pid)->home_node;
+            uint64_t node_latency = vm->memory_latency(pid, pa);
+            uint64_t local = vm->numa_topology()->latency(home, home);
+            if (!dram)
+                ram_latency = node_latency;
+            else if (node_latency > local)
+                ram_latency += node_latency - local;
+        }
+        r.total_cycles += ram_latency;
+        L3.access(pa);
+        L2.access(pa);
+        L1.access(pa);
+    };
+
+    StatsRegistry registry;
+    Histogram access_latency; // cycles per reference, translation included
+    if (stats) {
+        registry.counter("replay.references", &r.references);
+        registry.counter("replay.cycles", &r.total_cycles);
+        registry.histogram("replay.access_latency", &access_latency);
+        L1.register_stats(registry, "l1");
+        L2.register_stats(registry, "l2");
+        L3.register_stats(registry, "l3");
+        if (vm)
+            vm->register_stats(registry, "vm");
+        if (dram)
+            dram->register_stats(registry, "dram");
+        if (profile_compiled())
+            register_profile(registry, "host");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    while (trace.next(rec)) {
+        if (!rec.is_access()) {
+            r.skipped++;
+            continue;
+        }
+        uint64_t begin = r.total_cycles;
+        uint64_t pa = rec.addr;
+        if (vm) {
+            uint64_t before = vm->cycles();
+            try {
+                pa = vm->translate(rec.pid, rec.addr, rec.op == TraceOp::WRITE);
+            } catch (const std::exception &e) {
+                throw std::runtime_error("Reference " + std::to_string(r.references + 1) + ": " + e.what());
+            }
+            r.total_cycles += vm->cycles() - before; // TLB, page walk and swap I/O
+        }
+        r.references++;
+        hierarchy(pa, rec.pid);
+        access_latency.record(r.total_cycles - begin);
+        if (stats && stats->every && r.references % stats->every == 0)
+            snapshot(registry, *stats);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    r.seconds = elapsed.count();
+    if (stats && !(stats->every && r.references && r.references % stats->every == 0))
+        snapshot(registry, *stats); // unless the last periodic one already has the final counts
+
+    if (vm) {
+        vm_counters(*vm, r);
+        r.page_hits -= warm.page_hits;
+        r.page_faults -= warm.page_faults;
+        r.major_faults -= warm.major_faults;
+        r.writebacks -= warm.writebacks;
+        r.tlb_hits -= warm.tlb_hits;
+        r.tlb_misses -= warm.tlb_misses;
+        r.page_walks -= warm.page_walks;
+        r.translation_cycles -= warm.translation_cycles;
+        r.fault_cycles -= warm.fault_cycles;
+    }
+    if (dram) {
+        r.row_hits = dram->row_hits;
+        r.row_misses = dram->row_misses;
+        r.row_conflicts = dram->row_conflicts;
+        r.dram_latency = dram->average_latency();
+    }
+    for (int i = 0; i < 3; i++)
+        r.victim_hits[i] = levels[i]->victim_hits - warm_victim_hits[i];
+
+    if (!cfg.checkpoint.empty()) {
+        CheckpointWriter out;
+        if (vm)
+            vm->checkpoint(out);
+        L1.checkpoint(out);
+        L2.checkpoint(out);
+        L3.checkpoint(out);
+        out.save(cfg.checkpoint);
+    }
+    return r;
+}
+
+/* ---------------- OUTPUT ---------------- */
+
+void print_result(std::ostream &out, const BatchConfig &cfg, const BatchResult &r)
+{
+    out << "References: " << r.references << "\n";
+    out << "Replay time: " << r.seconds << " s ("
+        << (r.seconds > 0 ? r.references / r.seconds : 0.0) << " references/s)\n";
+    if (r.skipped)
+        out << "Skipped records: " << r.skipped << "\n";
+    if (cfg.mode == BatchMode::ALLOC) {
+        out << "Allocations: " << r.allocations << " Failed: " << r.alloc_failures << " Frees: " << r.frees << "\n";
+        out << "Live: " << r.requested_bytes << " bytes requested in " << r.allocated_bytes << " bytes of blocks"
+            << " (internal fragmentation " << 1.0 - ratio(r.requested_bytes, r.allocated_bytes) << ")\n";
+        out << "Peak block bytes: " << r.peak_bytes << "\n";
+        out << "Free: " << r.free_bytes << " bytes, largest block " << r.largest_free
+            << " (external fragmentation " << (r.free_bytes ? 1.0 - ratio(r.largest_free, r.free_bytes) : 0.0) << ")\n";
+        return;
+    }
+    if (cfg.mode == BatchMode::VM) {
+        out << "Page Hits: " << r.page_hits << "\n";
+        out << "Page Faults: " << r.page_faults << " (fault rate " << ratio(r.page_faults, r.references) << ")\n";
+        out << "Major faults (read from swap): " << r.major_faults << "\n";
+        out << "Dirty write-backs: " << r.writebacks << "\n";
+        out << "Fault service cycles: " << r.fault_cycles << "\n";
+        if (cfg.tlb) {
+            out << "TLB Hits: " << r.tlb_hits << " Misses: " << r.tlb_misses << "\n";
+            out << "Page walks: " << r.page_walks << " Translation cycles: " << r.translation_cycles << "\n";
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        out << "L" << i + 1 << " Hits: " << r.cache_hits[i] << " Misses: " << r.cache_misses[i]
+            << " (hit rate " << ratio(r.cache_hits[i], r.cache_hits[i] + r.cache_misses[i]) << ")";
+        if (cfg.cache_victim[i])
+            out << " Victim cache hits: " << r.victim_hits[i];
+        out << "\n";
+    }
+    out << "RAM accesses: " << r.ram_accesses << "\n";
+    if (cfg.dram) {
+        out << "DRAM Row hits: " << r.row_hits << " Row misses: " << r.row_misses
+            << " Row conflicts: " << r.row_conflicts
+            << " (row-buffer hit rate " << ratio(r.row_hits, r.ram_accesses) << ")\n";
+        out << "DRAM average latency: " << r.dram_latency << " cycles\n";
+    }
+    out << "Total Cycles: " << r.total_cycles << "\n";
+}
+
+static void usage(std::ostream &out)
+{
+    out << "Usage: simulator --mode cache|vm|alloc [--trace <file>] [--format text|lackey]\n"
+        << "                 [--config <file>] [--set key=value ...] [--convert <file> [--encoding fixed|delta]]\n"
+        << "                 [--sweep key=values ... [--threads <n>] [--csv <file>]]\n"
+        << "                 [--stats <file> [--stats-format json|csv] [--stats-every <n>]] [--events <file>]\n"
+        << "                 [--compare <allocators> [--compare-every <n>] [--csv <file>]]\n"
+        << "       simulator --print-events <file>\n"
+        << "  cache traces: <address> [r|w] per line, VM traces: <pid> <virtual address> [r|w],\n"
+        << "  allocator traces: alloc <id> <bytes> / free <id>; binary traces are recognised by their header\n"
+        << "  --convert writes the trace in the binary format instead of replaying it\n"
+        << "  --sweep key=v1,v2,a..b[*f|+s] (repeatable) runs the whole grid on --threads <n> threads,\n"
+        << "  one CSV row per configuration on stdout or in --csv <file>\n"
+        << "  --stats exports every counter, gauge and histogram of the replay (- for stdout),\n"
+        << "  at the end and every --stats-every <n> references\n"
+        << "  --events logs every cache, page and allocator decision (make EVENTS=1), --print-events\n"
+        << "  decodes such a log as CSV; with make PROFILE=1 the host time of each engine is printed\n"
+        << "  --compare buddy,first_fit,... replays an allocator trace through each of them in one pass,\n"
+        << "  a CSV time series every --compare-every <n> records (default 10000) on stdout or in --csv <file>\n"
+        << "  --set checkpoint=<file> saves the caches, VM or allocator after the replay,\n"
+        << "  --set restore=<file> starts the replay from such a checkpoint\n"
+        << "  without --trace, workload = sequential|strided|uniform|zipf|chase|phased|alloc generates one\n"
+        << "  options are applied in order, see README for the config keys\n"
+        << "  without arguments the interactive menus start\n";
+}
+
+// --sweep: the grid runs on a thread pool, one CSV row per configuration
+static int sweep(const BatchConfig &base, const std::vector<std::string> &specs, const std::string &trace_path,
+                 const std::string &format, size_t threads, const std::string &csv_path)
+{
+    std::vector<SweepAxis> axes;
+    for (const std::string &s : specs)
+        axes.push_back(parse_axis(s));
+    std::vector<SweepPoint> grid = expand_grid(base, axes);
+
+    std::unique_ptr<MappedFile> file;
+    if (!trace_path.empty())
+        file.reset(new MappedFile(trace_path));
+    auto start = std::chrono::steady_clock::now();
+    std::vector<SweepRun> runs = run_sweep(grid, file ? file->data() : nullptr, file ? file->size() : 0, format, threads);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    size_t failed = 0;
+    for (const SweepRun &r : runs)
+        failed += !r.error.empty();
+    if (csv_path.empty())
+        write_csv(std::cout, axes, grid, runs);
+    else {
+        std::ofstream out(csv_path);
+        if (!out)
+            throw std::runtime_error("Cannot create " + csv_path);
+        write_csv(out, axes, grid, runs);
+        std::cout << "Wrote " << grid.size() << " configurations to " << csv_path << "\n";
+    }
+    std::cerr << grid.size() << " configurations on " << std::min(threads, grid.size()) << " threads in "
+              << elapsed.count() << " s, " << failed << " failed\n";
+    return 0;
+}
+
+int run_batch(int argc, char **argv)
+{
+    BatchConfig cfg = default_batch_config();
+    std::string trace_path, format = "text", convert_path, csv_path, stats_path, events_path;
+    StatsOutput stats = {&std::cout, true, 0};
+    TraceEncoding encoding = TraceEncoding::DELTA;
+    std::vector<std::string> sweeps; // applied after every other option
+    std::vector<AllocatorKind> compare;
+    uint64_t compare_every = 10000;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--help" || arg == "-h") {
+                usage(std::cout);
+                return 0;
+            }
+            if (i + 1 >= argc)
+                throw std::invalid_argument(arg + " needs a value");
+            std::string value = argv[++i];
+            if (arg == "--mode")
+                set_option(cfg, "mode", value);
+            else if (arg == "--config")
+                load_config(cfg, value);
+            else if (arg == "--trace")
+                trace_path = value;
+            else if (arg == "--format") {
+                if (value != "text" && value != "lackey")
+                    throw std::invalid_argument("--format: expected text or lackey");
+                format = value;
+            }
+            else if (arg == "--convert")
+                convert_path = value;
+            else if (arg == "--encoding") {
+                if (value != "fixed" && value != "delta")
+                    throw std::invalid_argument("--encoding: expected fixed or delta");
+                encoding = value == "fixed" ? TraceEncoding::FIXED : TraceEncoding::DELTA;
+            }
+            else if (arg == "--sweep")
+                sweeps.push_back(value);
+            else if (arg == "--threads") {
+                threads = to_number(arg, value);
+                if (threads == 0)
+                    throw std::invalid_argument("--threads must not be 0");
+            }
+            else if (arg == "--csv")
+                csv_path = value;
+            else if (arg == "--compare") {
+                compare.clear();
+                for (size_t at = 0; at <= value.size();) {
+                    size_t comma = std::min(value.find(',', at), value.size());
+                    compare.push_back(parse_allocator(trim(value.substr(at, comma - at))));
+                    at = comma + 1;
+                }
+            }
+            else if (arg == "--compare-every")
+                compare_every = to_number(arg, value);
+            else if (arg == "--stats")
+                stats_path = value;
+            else if (arg == "--stats-format") {
+                if (value != "json" && value != "csv")
+                    throw std::invalid_argument("--stats-format: expected json or csv");
+                stats.json = value == "json";
+            }
+            else if (arg == "--stats-every")
+                stats.every = to_number(arg, value);
+            else if (arg == "--events")
+                events_path = value;
+            else if (arg == "--print-events") {
+                MappedFile log(value);
+                print_event_log(std::cout, log.data(), log.size());
+                return 0;
+            }
+            else if (arg == "--set") {
+                size_t eq = value.find('=');
+                if (eq == std::string::npos)
+                    throw std::invalid_argument("--set expects key=value");
+                set_option(cfg, trim(value.substr(0, eq)), trim(value.substr(eq + 1)));
+            }
+            else
+                throw std::invalid_argument("Unknown argument " + arg);
+        }
+        if (!sweeps.empty())
+            return sweep(cfg, sweeps, trace_path, format, threads, csv_path);
+        if (trace_path.empty() == (cfg.workload == BatchWorkload::TRACE))
+            throw std::invalid_argument("give either --trace or a workload");
+
+        std::unique_ptr<MappedFile> file;
+        std::unique_ptr<TraceSource> trace;
+        if (cfg.workload != BatchWorkload::TRACE)
+            trace = make_workload(cfg);
+        else {
+            file.reset(new MappedFile(trace_path));
+            trace = open_trace(file->data(), file->size(), format, cfg);
+        }
+
+        if (!convert_path.empty()) {
+            BinaryTraceWriter out(convert_path, encoding);
+            TraceRecord rec;
+            while (trace->next(rec))
+                out.write(rec);
+            out.close();
+            std::cout << "Wrote " << out.records() << " records to " << convert_path << "\n";
+            return 0;
+        }
+        if (!compare.empty()) {
+            if (cfg.mode != BatchMode::ALLOC)
+                throw std::invalid_argument("--compare needs --mode alloc");
+            if (csv_path.empty()) {
+                compare_allocators(cfg, *trace, compare, compare_every, std::cout);
+                return 0;
+            }
+            std::ofstream out(csv_path);
+            if (!out)
+                throw std::runtime_error("Cannot create " + csv_path);
+            compare_allocators(cfg, *trace, compare, compare_every, out);
+            std::cout << "Wrote " << compare.size() << " allocators to " << csv_path << "\n";
+            return 0;
+        }
+        std::ofstream stats_file;
+        if (!stats_path.empty() && stats_path != "-") {
+            stats_file.open(stats_path);
+            if (!stats_file)
+                throw std::runtime_error("Cannot create " + stats_path);
+            stats.out = &stats_file;
+        }
+        if (!events_path.empty()) {
+            if (!events_compiled())
+                throw std::runtime_error("Event tracing disabled, rebuild with: make clean && make EVENTS=1");
+            open_event_log(events_path);
+        }
+        reset_profile();
+        BatchResult result = run_trace(cfg, *trace, stats_path.empty() ? nullptr : &stats);
+        uint64_t events = close_event_log();
+        print_result(std::cout, cfg, result);
+        if (profile_compiled())
+            print_profile(std::cout);
+        if (!events_path.empty())
+            std::cout << "Wrote " << events << " events to " << events_path << "\n";
+    } catch (const std::invalid_argument &e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        usage(std::cerr);
+        return 1;
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << "\n"; // bad trace or a failed reference
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,229 @@
+// Microbenchmarks of the simulator engines over generated workloads.
+// One CSV row per benchmark on stdout:
+//     bench,engine,config,ops,seconds,ops_per_s,ns_per_op,p50_ns,p99_ns,p999_ns,max_ns
+// the percentiles come from every SAMPLE-th operation timed on its own (timer overhead subtracted)
+#include "include/memory.h"
+#include "include/buddy.h"
+#include "include/cache.h"
+#include "include/virtual_memory.h"
+#include "include/workload.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+
+using Clock = std::chrono::steady_clock;
+
+const uint64_t SAMPLE = 16;
+
+static double scale = 1.0;
+static std::string filter;
+static double timer_overhead = 0; // ns of one back-to-back now() pair
+
+struct BenchRow {
+    std::string bench;
+    std::string engine;
+    std::string config;
+    uint64_t ops;
+    double seconds;
+    double p50, p99, p999, max; // ns
+};
+
+static double since(Clock::time_point t0, Clock::time_point t1)
+{
+    return std::chrono::duration<double, std::nano>(t1 - t0).count();
+}
+
+static void calibrate()
+{
+    std::vector<double> d(10000);
+    for (auto &x : d) {
+        auto t0 = Clock::now();
+        auto t1 = Clock::now();
+        x = since(t0, t1);
+    }
+    std::sort(d.begin(), d.end());
+    timer_overhead = d[d.size() / 2];
+}
+
+static double percentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    size_t i = (size_t)(p * (sorted.size() - 1));
+    return sorted[i];
+}
+
+// runs op(i) for i = 0 .. ops - 1: the whole loop gives the throughput,
+// every SAMPLE-th call is timed on its own for the latency distribution
+template <typename Op>
+static void measure(const std::string &bench, const std::string &engine, const std::string &config,
+                    uint64_t ops, Op op)
+{
+    std::string name = bench + "/" + engine + "/" + config;
+    if (!filter.empty() && name.find(filter) == std::string::npos)
+        return;
+    std::vector<double> samples;
+    samples.reserve(ops / SAMPLE + 1);
+    auto start = Clock::now();
+    for (uint64_t i = 0; i < ops; i++) {
+        if (i % SAMPLE == 0) {
+            auto t0 = Clock::now();
+            op(i);
+            auto t1 = Clock::now();
+            samples.push_back(std::max(0.0, since(t0, t1) - timer_overhead));
+        }
+        else
+            op(i);
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::sort(samples.begin(), samples.end());
+
+    BenchRow r = {bench, engine, config, ops, seconds,
+                  percentile(samples, 0.5), percentile(samples, 0.99), percentile(samples, 0.999),
+                  samples.empty() ? 0 : samples.back()};
+    std::cout << r.bench << "," << r.engine << "," << r.config << "," << r.ops << ","
+              << std::fixed << std::setprecision(6) << r.seconds << ","
+              << std::setprecision(0) << (r.seconds > 0 ? r.ops / r.seconds : 0) << ","
+              << std::setprecision(2) << (r.ops ? r.seconds * 1e9 / r.ops : 0) << ","
+              << r.p50 << "," << r.p99 << "," << r.p999 << "," << r.max << "\n"
+              << std::defaultfloat << std::flush;
+}
+
+static uint64_t scaled(uint64_t n) { return std::max<uint64_t>(1, (uint64_t)(n * scale)); }
+
+static std::vector<TraceRecord> collect(TraceSource &src)
+{
+    std::vector<TraceRecord> v;
+    TraceRecord r;
+    while (src.next(r))
+        v.push_back(r);
+    return v;
+}
+
+/* ---------------- ALLOCATORS ---------------- */
+
+static void bench_allocators()
+{
+    AllocationWorkload w = default_allocation_workload();
+    w.lifetime = LifetimeModel::RANDOM;
+    w.live = 2000;
+
+    // the contiguous allocator walks a block list on every call, so it gets a shorter stream
+    w.count = scaled(50000);
+    AllocationGenerator small(w);
+    std::vector<TraceRecord> recs = collect(small);
+    const char *fits[] = {"first_fit", "best_fit", "worst_fit"};
+    for (int f = 0; f < 3; f++) {
+        PhysicalMemory heap(64 << 20);
+        std::vector<int> handle(recs.size(), -1); // allocation id -> block id
+        measure("alloc", fits[f], "random_live2000", recs.size(), [&](uint64_t i) {
+            const TraceRecord &r = recs[i];
+            if (r.op == TraceOp::ALLOC)
+                handle[r.addr] = f == 0 ? heap.allocate_first_fit(r.size)
+                               : f == 1 ? heap.allocate_best_fit(r.size)
+                                        : heap.allocate_worst_fit(r.size);
+            else if (handle[r.addr] >= 0)
+                heap.deallocate(handle[r.addr]);
+        });
+    }
+
+    w.count = scaled(2000000);
+    AllocationGenerator large(w);
+    recs = collect(large);
+    BuddyAllocator buddy(64 << 20, 16);
+    std::vector<size_t> addr(recs.size(), SIZE_MAX);
+    measure("alloc", "buddy", "random_live2000", recs.size(), [&](uint64_t i) {
+        const TraceRecord &r = recs[i];
+        if (r.op == TraceOp::ALLOC)
+            addr[r.addr] = buddy.allocate(r.size);
+        else
+            buddy.deallocate(addr[r.addr]);
+    });
+}
+
+/* ---------------- CACHE ---------------- */
+
+static void bench_cache()
+{
+    AddressWorkload w = default_address_workload();
+    w.pattern = AddressPattern::ZIPF;
+    w.count = scaled(2000000);
+    w.footprint = 16 << 20;
+    AddressGenerator gen(w);
+    std::vector<TraceRecord> recs = collect(gen);
+
+    const ReplacementPolicy policies[] = {ReplacementPolicy::FIFO, ReplacementPolicy::LRU, ReplacementPolicy::LFU};
+    const char *names[] = {"fifo", "lru", "lfu"};
+    const size_t ways[] = {1, 4, 8, 16};
+    for (int p = 0; p < 3; p++)
+        for (size_t a : ways) {
+            Cache cache(256 * 1024, 64, a, policies[p], 1);
+            measure("cache", names[p], std::to_string(a) + "way_256k_zipf", recs.size(),
+                    [&](uint64_t i) { cache.access(recs[i].addr); });
+        }
+}
+
+/* ---------------- VIRTUAL MEMORY ---------------- */
+
+static void bench_vm()
+{
+    const size_t page_size = 4096;
+    const uint64_t pages = 16384; // 64 MiB per process
+    AddressWorkload w = default_address_workload();
+    w.pattern = AddressPattern::ZIPF;
+    w.count = scaled(1000000);
+    w.footprint = pages * page_size;
+    w.processes = 2;
+    AddressGenerator gen(w);
+    std::vector<TraceRecord> recs = collect(gen);
+
+    const PageReplacement policies[] = {PageReplacement::FIFO, PageReplacement::LRU, PageReplacement::CLOCK,
+                                        PageReplacement::AGING, PageReplacement::WSCLOCK, PageReplacement::OPT};
+    const char *names[] = {"fifo", "lru", "clock", "aging", "wsclock", "opt"};
+    for (int p = 0; p < 6; p++) {
+        VirtualMemory vm(pages, 2048, page_size, policies[p]);
+        for (int pid = 0; pid < (int)w.processes; pid++)
+            vm.create_process(pid, pages);
+        vm.configure_tlb({16, 4, ReplacementPolicy::LRU, 1, 1}, {128, 12, ReplacementPolicy::LRU, 7, 7}, true, 20);
+        if (policies[p] == PageReplacement::OPT) {
+            std::vector<SwapKey> refs;
+            for (const TraceRecord &r : recs)
+                refs.push_back({r.pid, r.addr / page_size});
+            vm.set_future(refs);
+        }
+        measure("translate", names[p], "2proc_2048frames_zipf", recs.size(), [&](uint64_t i) {
+            const TraceRecord &r = recs[i];
+            vm.translate(r.pid, r.addr, r.op == TraceOp::WRITE);
+        });
+    }
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--scale" && i + 1 < argc)
+            scale = std::stod(argv[++i]);
+        else if (arg == "--filter" && i + 1 < argc)
+            filter = argv[++i];
+        else {
+            std::cerr << "Usage: simulator_bench [--scale <factor>] [--filter <bench/engine/config substring>]\n";
+            return 1;
+        }
+    }
+    try {
+        calibrate();
+        std::cout << "bench,engine,config,ops,seconds,ops_per_s,ns_per_op,p50_ns,p99_ns,p999_ns,max_ns\n";
+        bench_allocators();
+        bench_cache();
+        bench_vm();
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,246 @@
+#include "include/binary_trace.h"
+#include <cstring>
+#include <stdexcept>
+
+/* ---------------- ENCODING HELPERS ---------------- */
+
+static const char MAGIC[4] = {'M', 'M', 'T', 'R'};
+static const uint16_t VERSION = 1;
+
+static uint64_t load_le(const unsigned char *p, int bytes)
+{
+    uint64_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+static void store_le(unsigned char *p, uint64_t v, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        p[i] = (unsigned char)v;
+        v >>= 8;
+    }
+}
+
+static void put_varint(std::vector<unsigned char> &out, uint64_t v)
+{
+    while (v >= 0x80) {
+        out.push_back((unsigned char)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((unsigned char)v);
+}
+
+// false if the varint runs past end or over 64 bits
+static bool get_varint(const unsigned char *&p, const unsigned char *end, uint64_t &v)
+{
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p == end)
+            return false;
+        unsigned char b = *p++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+static int64_t unzigzag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+const unsigned char TAG_OP = 0x07;
+const unsigned char TAG_PID = 0x08;
+const unsigned char TAG_SIZE = 0x10;
+
+bool is_binary_trace(const char *data, size_t size)
+{
+    return size >= BINARY_TRACE_HEADER && memcmp(data, MAGIC, 4) == 0;
+}
+
+/* ---------------- READER ---------------- */
+
+BinaryTrace::BinaryTrace(const char *data, size_t size)
+{
+    if (!is_binary_trace(data, size))
+        throw std::runtime_error("Not a binary trace");
+    const unsigned char *h = reinterpret_cast<const unsigned char *>(data);
+    if (load_le(h + 4, 2) != VERSION)
+        throw std::runtime_error("Unsupported binary trace version " + std::to_string(load_le(h + 4, 2)));
+    uint64_t enc = load_le(h + 6, 2);
+    if (enc != (uint64_t)TraceEncoding::FIXED && enc != (uint64_t)TraceEncoding::DELTA)
+        throw std::runtime_error("Unknown binary trace encoding " + std::to_string(enc));
+    encoding = (TraceEncoding)enc;
+    total = load_le(h + 12, 8);
+    begin = h + BINARY_TRACE_HEADER;
+    end = h + size;
+    if (encoding == TraceEncoding::FIXED && (uint64_t)(end - begin) / BINARY_TRACE_RECORD < total)
+        throw std::runtime_error("Binary trace is truncated");
+    rewind();
+}
+
+void BinaryTrace::rewind()
+{
+    cur = begin;
+    block_end = begin;
+    block_left = 0;
+}
+
+bool BinaryTrace::next_block()
+{
+    cur = block_end;
+    if (cur == end)
+        return false;
+    if (end - cur < 8)
+        throw std::runtime_error("Binary trace: truncated block header");
+    block_left = (uint32_t)load_le(cur, 4);
+    uint64_t bytes = load_le(cur + 4, 4);
+    cur += 8;
+    if ((uint64_t)(end - cur) < bytes)
+        throw std::runtime_error("Binary trace: truncated block");
+    block_end = cur + bytes;
+    prev = TraceRecord{TraceOp::READ, 0, 0, 0};
+    return true;
+}
+
+bool BinaryTrace::next(TraceRecord &r)
+{
+    if (encoding == TraceEncoding::FIXED) {
+        if ((uint64_t)(cur - begin) / BINARY_TRACE_RECORD >= total)
+            return false;
+        unsigned char op = cur[14];
+        if (op > (unsigned char)TraceOp::FREE)
+            throw std::runtime_error("Binary trace: bad op in record " +
+                                     std::to_string((cur - begin) / BINARY_TRACE_RECORD + 1));
+        r.op = (TraceOp)op;
+        r.addr = load_le(cur, 8);
+        r.size = (uint32_t)load_le(cur + 8, 4);
+        r.pid = (int)load_le(cur + 12, 2);
+        cur += BINARY_TRACE_RECORD;
+        return true;
+    }
+
+    while (block_left == 0)
+        if (!next_block())
+            return false;
+    if (cur == block_end)
+        throw std::runtime_error("Binary trace: block ends early");
+    unsigned char tag = *cur++;
+    if ((tag & TAG_OP) > (unsigned char)TraceOp::FREE || (tag & ~(TAG_OP | TAG_PID | TAG_SIZE)))
+        throw std::runtime_error("Binary trace: bad record tag");
+    uint64_t v;
+    if (tag & TAG_PID) {
+        if (!get_varint(cur, block_end, v))
+            throw std::runtime_error("Binary trace: bad pid");
+        prev.pid = (int)v;
+    }
+    if (tag & TAG_SIZE) {
+        if (!get_varint(cur, block_end, v))
+            throw std::runtime_error("Binary trace: bad size");
+        prev.size = (uint32_t)v;
+    }
+    if (!get_varint(cur, block_end, v))
+        throw std::runtime_error("Binary trace: bad address");
+    prev.addr += (uint64_t)unzigzag(v);
+    prev.op = (TraceOp)(tag & TAG_OP);
+    block_left--;
+    r = prev;
+    return true;
+}
+
+/* ---------------- WRITER ---------------- */
+
+BinaryTraceWriter::BinaryTraceWriter(const std::string &file, TraceEncoding enc, uint32_t per_block)
+    : out(file, std::ios::binary | std::ios::trunc),
+      path(file),
+      encoding(enc),
+      block_records(per_block),
+      total(0),
+      in_block(0),
+      prev{TraceOp::READ, 0, 0, 0}
+{
+    if (!out)
+        throw std::runtime_error("Cannot create " + path);
+    if (block_records == 0)
+        throw std::runtime_error("Blocks need at least one record");
+    // the record count is filled in by close()
+    unsigned char h[BINARY_TRACE_HEADER] = {};
+    memcpy(h, MAGIC, 4);
+    store_le(h + 4, VERSION, 2);
+    store_le(h + 6, (uint64_t)encoding, 2);
+    store_le(h + 8, encoding == TraceEncoding::DELTA ? block_records : 0, 4);
+    out.write(reinterpret_cast<const char *>(h), sizeof h);
+}
+
+BinaryTraceWriter::~BinaryTraceWriter()
+{
+    if (out.is_open()) {
+        try {
+            close();
+        } catch (const std::exception &) {
+        }
+    }
+}
+
+void BinaryTraceWriter::write(const TraceRecord &r)
+{
+    if (r.pid < 0 || r.pid > 0xffff)
+        throw std::out_of_range("Binary traces hold pids 0 to 65535");
+
+    if (encoding == TraceEncoding::FIXED) {
+        unsigned char rec[BINARY_TRACE_RECORD] = {};
+        store_le(rec, r.addr, 8);
+        store_le(rec + 8, r.size, 4);
+        store_le(rec + 12, (uint64_t)r.pid, 2);
+        rec[14] = (unsigned char)r.op;
+        out.write(reinterpret_cast<const char *>(rec), sizeof rec);
+        total++;
+        return;
+    }
+
+    unsigned char tag = (unsigned char)r.op;
+    if (r.pid != prev.pid)
+        tag |= TAG_PID;
+    if (r.size != prev.size)
+        tag |= TAG_SIZE;
+    block.push_back(tag);
+    if (tag & TAG_PID)
+        put_varint(block, (uint64_t)r.pid);
+    if (tag & TAG_SIZE)
+        put_varint(block, r.size);
+    put_varint(block, zigzag((int64_t)(r.addr - prev.addr)));
+    prev = r;
+    total++;
+    if (++in_block == block_records)
+        flush_block();
+}
+
+void BinaryTraceWriter::flush_block()
+{
+    if (in_block == 0)
+        return;
+    unsigned char h[8];
+    store_le(h, in_block, 4);
+    store_le(h + 4, block.size(), 4);
+    out.write(reinterpret_cast<const char *>(h), sizeof h);
+    out.write(reinterpret_cast<const char *>(block.data()), block.size());
+    block.clear();
+    in_block = 0;
+    prev = TraceRecord{TraceOp::READ, 0, 0, 0};
+}
+
+void BinaryTraceWriter::close()
+{
+    if (!out.is_open())
+        return;
+    flush_block();
+    unsigned char n[8];
+    store_le(n, total, 8);
+    out.seekp(12);
+    out.write(reinterpret_cast<const char *>(n), sizeof n);
+    bool ok = (bool)out;
+    out.close();
+    if (!ok)
+        throw std::runtime_error("Cannot write " + path);
+}
@@ -1,12 +1,25 @@
 #include "include/buddy.h"
+#include "include/event_trace.h"
+#include "include/checkpoint.h"
 #include <iostream>
 #include <cmath>
 #include <stdexcept>
+#include <algorithm>
 
 BuddyAllocator::BuddyAllocator(size_t total, size_t min_block) : total_size(total), min_block_size(min_block)
 {
-    max_order = get_order(total_size);
-    free_lists[max_order].insert(0); // entire memory free
+    // entire memory free: the biggest power of two blocks that fit, one after another,
+    // so a size that is not a power of two never hands out memory past the end
+    max_order = 0;
+    size_t addr = 0;
+    for (int order = get_order(total_size); order >= 0; order--)
+    {
+        if (addr + get_block_size(order) > total_size)
+            continue;
+        free_lists[order].insert(addr);
+        addr += get_block_size(order);
+        max_order = std::max(max_order, order);
+    }
 }
 
 int BuddyAllocator::get_order(size_t size) const // returns order
@@ -35,6 +48,8 @@ size_t BuddyAllocator::get_buddy(size_t addr, int order) const
 
 size_t BuddyAllocator::allocate(size_t size)
 {
+    SIM_PROFILE(BUDDY_ALLOCATE);
+    request_sizes.record(size);
     int order = get_order(size);
 
     int current_order = order;
@@ -43,7 +58,10 @@ size_t BuddyAllocator::allocate(size_t size)
         current_order++;
     }
     if (current_order > max_order)
+    {
+        SIM_EVENT(ALLOC_FAIL, EVENT_UNIT_BUDDY, size, 0);
         throw std::runtime_error("Out of memory");
+    }
     // Split blocks until desired order
     size_t addr = *free_lists[current_order].begin();
     free_lists[current_order].erase(addr);
@@ -53,6 +71,7 @@ size_t BuddyAllocator::allocate(size_t size)
         current_order--;
         size_t buddy = addr + get_block_size(current_order);
         free_lists[current_order].insert(buddy);
+        SIM_EVENT(ALLOC_SPLIT, EVENT_UNIT_BUDDY, buddy, current_order);
     }
     allocated[addr] = order;
     return addr;
@@ -60,6 +79,7 @@ size_t BuddyAllocator::allocate(size_t size)
 
 void BuddyAllocator::deallocate(size_t addr)
 {
+    SIM_PROFILE(BUDDY_FREE);
     auto it = allocated.find(addr);
     if (it == allocated.end())
         throw std::runtime_error("Invalid free");
@@ -75,10 +95,91 @@ void BuddyAllocator::deallocate(size_t addr)
         free_set.erase(buddy);
         addr = std::min(addr, buddy);
         order++;
+        SIM_EVENT(ALLOC_MERGE, EVENT_UNIT_BUDDY, addr, order);
     }
     free_lists[order].insert(addr);
 }
 
+size_t BuddyAllocator::free_size() const
+{
+    size_t n = 0;
+    for (const auto &p : free_lists)
+        n += p.second.size() * get_block_size(p.first);
+    return n;
+}
+
+size_t BuddyAllocator::largest_free_block() const
+{
+    for (auto it = free_lists.rbegin(); it != free_lists.rend(); ++it)
+        if (!it->second.empty())
+            return get_block_size(it->first);
+    return 0;
+}
+
+void BuddyAllocator::register_stats(StatsRegistry &stats, const std::string &prefix) const
+{
+    stats.gauge(prefix + ".free_bytes", [this]() { return (double)free_size(); });
+    stats.gauge(prefix + ".largest_free_block", [this]() { return (double)largest_free_block(); });
+    stats.gauge(prefix + ".allocated_blocks", [this]() { return (double)allocated.size(); });
+    stats.histogram(prefix + ".request_sizes", &request_sizes);
+    stats.distribution(prefix + ".free_blocks", [this]() {
+        Histogram h;
+        for (const auto &p : free_lists)
+            for (size_t i = 0; i < p.second.size(); i++)
+                h.record(get_block_size(p.first));
+        return h;
+    });
+}
+
+void BuddyAllocator::checkpoint(CheckpointWriter &out) const
+{
+    out.begin("BUDY");
+    out.put(total_size);
+    out.put(min_block_size);
+    out.put(free_lists.size());
+    for (const auto &p : free_lists)
+    {
+        out.put(p.first);
+        out.put(p.second.size());
+        for (size_t addr : p.second)
+            out.put(addr);
+    }
+    out.put(allocated.size());
+    for (const auto &a : allocated)
+    {
+        out.put(a.first);
+        out.put(a.second);
+    }
+    request_sizes.checkpoint(out);
+    out.end();
+}
+
+void BuddyAllocator::restore(CheckpointReader &in)
+{
+    in.begin("BUDY");
+    if (in.get() != total_size || in.get() != min_block_size)
+        throw std::runtime_error("Checkpoint buddy allocator has a different size");
+    free_lists.clear();
+    allocated.clear();
+    uint64_t orders = in.get_below(max_order + 2, "free list count");
+    for (uint64_t i = 0; i < orders; i++)
+    {
+        int order = (int)in.get_below(max_order + 1, "order");
+        auto &list = free_lists[order];
+        uint64_t n = in.get_below(total_size / get_block_size(order) + 1, "free list length");
+        for (uint64_t j = 0; j < n; j++)
+            list.insert(in.get_below(total_size, "block address"));
+    }
+    uint64_t live = in.get_below(total_size / min_block_size + 1, "block count");
+    for (uint64_t i = 0; i < live; i++)
+    {
+        size_t addr = in.get_below(total_size, "block address");
+        allocated[addr] = (int)in.get_below(max_order + 1, "order");
+    }
+    request_sizes.restore(in);
+    in.end();
+}
+
 void BuddyAllocator::dump() const
 {
     std::cout << "===== Buddy Allocator State(Free Block Addresses) =====\n";
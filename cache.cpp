@@ -1,5 +1,10 @@
 #include "include/cache.h"
+#include "include/event_trace.h"
+#include "include/checkpoint.h"
+#include <stdexcept>
 #include <limits>
+#include <algorithm>
+#include <ostream>
 
 Cache::Cache(size_t csize,size_t bsize,size_t assoc,ReplacementPolicy pol,uint64_t latency):
       cache_size(csize),
@@ -10,13 +15,21 @@ Cache::Cache(size_t csize,size_t bsize,size_t assoc,ReplacementPolicy pol,uint64
       global_time(0),
       hits(0),
       misses(0),
-      total_cycles(0)
+      total_cycles(0),
+      victim_hits(0)
 { 
     size_t total_blocks = cache_size / block_size;
     num_sets = total_blocks / associativity;
 
     sets.resize(num_sets,
         std::vector<CacheLine>(associativity, {false, 0, 0, 0, 0}));
+    event_unit = 0;
+    psel = PSEL_MAX / 2; // followers start with LRU
+
+#ifdef CACHE_INSTRUMENT
+    region_size = 4096;
+    set_stats.resize(num_sets, AccessCounters{});
+#endif
 }
 
 size_t Cache::get_set_index(uint64_t address) const
@@ -29,6 +42,106 @@ uint64_t Cache::get_tag(uint64_t address) const
     return (address / block_size) / num_sets;
 }
 
+/* ---------------- INSTRUMENTATION ---------------- */
+#ifdef CACHE_INSTRUMENT
+static int reuse_bucket(size_t distance)
+{
+    int bucket = 0;
+    while (distance > 0 && bucket < REUSE_BUCKETS - 2)
+    {
+        distance >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+// number of lines in the set used more recently than this one
+size_t Cache::stack_distance(size_t set_index, const CacheLine &line) const
+{
+    size_t distance = 0;
+    for (const auto &other : sets[set_index])
+        if (other.valid && other.last_used > line.last_used)
+            distance++;
+    return distance;
+}
+
+AccessCounters &Cache::region_counters(uint64_t address)
+{
+    return region_stats[address / region_size]; // value initialised to zero on first touch
+}
+
+static void write_counters_header(std::ostream &out, const char *key)
+{
+    out << "level," << key << ",hits,misses,evictions,miss_rate,"
+        << "d0,d1,d2_3,d4_7,d8_15,d16_31,d32p,miss\n";
+}
+#endif
+
+bool Cache::instrumented()
+{
+#ifdef CACHE_INSTRUMENT
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Cache::set_region_size(size_t bytes)
+{
+#ifdef CACHE_INSTRUMENT
+    if (bytes == 0)
+        return;
+    region_size = bytes;
+    region_stats.clear();
+#else
+    (void)bytes;
+#endif
+}
+
+void Cache::dump_set_stats(std::ostream &out, const char *level, bool header) const
+{
+#ifdef CACHE_INSTRUMENT
+    if (header)
+        write_counters_header(out, "set");
+    for (size_t i = 0; i < num_sets; i++)
+    {
+        const AccessCounters &c = set_stats[i];
+        uint64_t total = c.hits + c.misses;
+        out << level << "," << i << "," << c.hits << "," << c.misses << "," << c.evictions << ","
+            << (total == 0 ? 0.0 : (double)c.misses / total);
+        for (int b = 0; b < REUSE_BUCKETS; b++)
+            out << "," << c.reuse[b];
+        out << "\n";
+    }
+#else
+    (void)out;
+    (void)level;
+    (void)header;
+#endif
+}
+
+void Cache::dump_region_stats(std::ostream &out, const char *level, bool header) const
+{
+#ifdef CACHE_INSTRUMENT
+    if (header)
+        write_counters_header(out, "region_start");
+    for (const auto &r : region_stats)
+    {
+        const AccessCounters &c = r.second;
+        uint64_t total = c.hits + c.misses;
+        out << level << "," << r.first * region_size << "," << c.hits << "," << c.misses << "," << c.evictions << ","
+            << (total == 0 ? 0.0 : (double)c.misses / total);
+        for (int b = 0; b < REUSE_BUCKETS; b++)
+            out << "," << c.reuse[b];
+        out << "\n";
+    }
+#else
+    (void)out;
+    (void)level;
+    (void)header;
+#endif
+}
+
 /* ---------------- FIFO ---------------- */
 int Cache::find_fifo_victim(size_t set_index)
 {
@@ -89,8 +202,66 @@ int Cache::find_lfu_victim(size_t set_index)
     return victim;
 }
 
+/* ---------------- ADAPTIVE ---------------- */
+ReplacementPolicy Cache::set_policy(size_t set_index) const
+{
+    if (policy != ReplacementPolicy::ADAPTIVE)
+        return policy;
+    size_t period = std::min(DUEL_PERIOD, num_sets);
+    if (period >= 2 && set_index % period == 0)
+        return ReplacementPolicy::LRU;
+    if (period >= 2 && set_index % period == period / 2)
+        return ReplacementPolicy::LFU;
+    return lfu_winning() ? ReplacementPolicy::LFU : ReplacementPolicy::LRU;
+}
+
+void Cache::duel(size_t set_index)
+{
+    size_t period = std::min(DUEL_PERIOD, num_sets);
+    if (policy != ReplacementPolicy::ADAPTIVE || period < 2)
+        return;
+    if (set_index % period == 0 && psel < PSEL_MAX)
+        psel++;
+    else if (set_index % period == period / 2 && psel > 0)
+        psel--;
+}
+
+int Cache::find_victim(size_t set_index)
+{
+    ReplacementPolicy p = set_policy(set_index);
+    if (p == ReplacementPolicy::FIFO)
+        return find_fifo_victim(set_index);
+    if (p == ReplacementPolicy::LRU)
+        return find_lru_victim(set_index);
+    return find_lfu_victim(set_index);
+}
+
+/* ---------------- VICTIM CACHE ---------------- */
+void Cache::set_victim_cache(size_t entries)
+{
+    victims.assign(entries, {false, 0, 0, 0});
+}
+
+// the line leaves the sets; the least recently used entry makes room
+void Cache::victim_insert(const CacheLine &line, size_t set_index)
+{
+    size_t slot = 0;
+    for (size_t i = 0; i < victims.size(); i++)
+    {
+        if (!victims[i].valid)
+        {
+            slot = i;
+            break;
+        }
+        if (victims[i].last_used < victims[slot].last_used)
+            slot = i;
+    }
+    victims[slot] = {true, line.tag * num_sets + set_index, global_time, line.frequency};
+}
+
 bool Cache::access(uint64_t address)
 {
+    SIM_PROFILE(CACHE_ACCESS);
     global_time++;
     total_cycles += hit_latency;
 
@@ -102,23 +273,69 @@ bool Cache::access(uint64_t address)
     {
         if (line.valid && line.tag == tag)
         {
+#ifdef CACHE_INSTRUMENT
+            int bucket = reuse_bucket(stack_distance(set_index, line));
+            AccessCounters &region = region_counters(address);
+            set_stats[set_index].hits++;
+            set_stats[set_index].reuse[bucket]++;
+            region.hits++;
+            region.reuse[bucket]++;
+#endif
             hits++;
             line.last_used = global_time;
             line.frequency++;
+            SIM_EVENT(CACHE_HIT, event_unit, address, set_index);
+            return true;
+        }
+    }
+
+    // VICTIM CACHE HIT: swap with the line the set gives up
+    uint64_t block = address / block_size;
+    for (auto &v : victims)
+    {
+        if (v.valid && v.block == block)
+        {
+            hits++;
+            victim_hits++;
+            total_cycles++;
+            CacheLine &line = sets[set_index][find_victim(set_index)];
+            VictimLine back = v;
+            v.valid = false;
+            if (line.valid)
+                victim_insert(line, set_index);
+            line = {true, tag, global_time, global_time, back.frequency + 1};
+            SIM_EVENT(CACHE_HIT, event_unit, address, set_index);
             return true;
         }
     }
 
     // MISS
     misses++;
+    SIM_EVENT(CACHE_MISS, event_unit, address, set_index);
+    duel(set_index);
 
-    int victim;
-    if (policy == ReplacementPolicy::FIFO)
-        victim = find_fifo_victim(set_index);
-    else if (policy == ReplacementPolicy::LRU)
-        victim = find_lru_victim(set_index);
-    else
-        victim = find_lfu_victim(set_index);
+    int victim = find_victim(set_index);
+
+#ifdef CACHE_INSTRUMENT
+    AccessCounters &region = region_counters(address);
+    set_stats[set_index].misses++;
+    set_stats[set_index].reuse[REUSE_BUCKETS - 1]++;
+    region.misses++;
+    region.reuse[REUSE_BUCKETS - 1]++;
+    if (sets[set_index][victim].valid)
+    {
+        // charge the eviction to the region of the line that gets thrown out
+        uint64_t victim_addr = (sets[set_index][victim].tag * num_sets + set_index) * block_size;
+        set_stats[set_index].evictions++;
+        region_counters(victim_addr).evictions++;
+    }
+#endif
+    if (sets[set_index][victim].valid)
+    {
+        SIM_EVENT(CACHE_EVICT, event_unit, (sets[set_index][victim].tag * num_sets + set_index) * block_size, set_index);
+        if (!victims.empty())
+            victim_insert(sets[set_index][victim], set_index);
+    }
 
     sets[set_index][victim] = {
         true,
@@ -130,3 +347,91 @@ bool Cache::access(uint64_t address)
 
     return false;
 }
+
+/* ---------------- CHECKPOINT ---------------- */
+void Cache::checkpoint(CheckpointWriter &out) const
+{
+    out.begin("CACH");
+    out.put(cache_size);
+    out.put(block_size);
+    out.put(associativity);
+    out.put(global_time);
+    out.put(hits);
+    out.put(misses);
+    out.put(total_cycles);
+    out.put(victim_hits);
+    out.put(psel);
+    for (const auto &set : sets)
+        for (const auto &line : set)
+        {
+            out.put_bool(line.valid);
+            if (!line.valid)
+                continue;
+            out.put(line.tag);
+            out.put(line.arrival_time);
+            out.put(line.last_used);
+            out.put(line.frequency);
+        }
+    out.put(victims.size());
+    for (const auto &v : victims)
+    {
+        out.put_bool(v.valid);
+        if (!v.valid)
+            continue;
+        out.put(v.block);
+        out.put(v.last_used);
+        out.put(v.frequency);
+    }
+    out.end();
+}
+
+void Cache::restore(CheckpointReader &in)
+{
+    in.begin("CACH");
+    if (in.get() != cache_size || in.get() != block_size || in.get() != associativity)
+        throw std::runtime_error("Checkpoint cache has a different geometry");
+    global_time = in.get();
+    hits = in.get();
+    misses = in.get();
+    total_cycles = in.get();
+    victim_hits = in.get();
+    psel = (unsigned)in.get_below(PSEL_MAX + 1, "policy selector");
+    for (auto &set : sets)
+        for (auto &line : set)
+        {
+            line = {false, 0, 0, 0, 0};
+            if (!in.get_bool())
+                continue;
+            line.valid = true;
+            line.tag = in.get();
+            line.arrival_time = in.get();
+            line.last_used = in.get();
+            line.frequency = in.get();
+        }
+    if (in.get() != victims.size())
+        throw std::runtime_error("Checkpoint cache has a different victim cache");
+    for (auto &v : victims)
+    {
+        v = {false, 0, 0, 0};
+        if (!in.get_bool())
+            continue;
+        v.valid = true;
+        v.block = in.get();
+        v.last_used = in.get();
+        v.frequency = in.get();
+    }
+    in.end();
+}
+
+void Cache::register_stats(StatsRegistry &stats, const std::string &prefix) const
+{
+    stats.counter(prefix + ".hits", &hits);
+    stats.counter(prefix + ".misses", &misses);
+    stats.gauge(prefix + ".hit_rate", [this]() {
+        return hits + misses ? (double)hits / (hits + misses) : 0.0;
+    });
+    if (!victims.empty())
+        stats.counter(prefix + ".victim_hits", &victim_hits);
+    if (policy == ReplacementPolicy::ADAPTIVE)
+        stats.gauge(prefix + ".psel", [this]() { return (double)psel; });
+}
@@ -0,0 +1,158 @@
+#include "include/checkpoint.h"
+#include <fstream>
+#include <iterator>
+#include <cstring>
+#include <stdexcept>
+
+static const char MAGIC[4] = {'M', 'M', 'C', 'K'};
+const size_t HEADER_BYTES = 8;
+
+/* ---------------- WRITER ---------------- */
+
+void CheckpointWriter::begin(const char *tag)
+{
+    buf.insert(buf.end(), tag, tag + 4);
+    open.push_back(buf.size());
+    buf.insert(buf.end(), 8, 0); // length, patched by end()
+}
+
+void CheckpointWriter::end()
+{
+    size_t at = open.back();
+    open.pop_back();
+    uint64_t len = buf.size() - at - 8;
+    for (int i = 0; i < 8; i++, len >>= 8)
+        buf[at + i] = (unsigned char)len;
+}
+
+void CheckpointWriter::put(uint64_t v)
+{
+    while (v >= 0x80) {
+        buf.push_back((unsigned char)(v | 0x80));
+        v >>= 7;
+    }
+    buf.push_back((unsigned char)v);
+}
+
+void CheckpointWriter::put_signed(int64_t v)
+{
+    put(((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+void CheckpointWriter::put_double(double v)
+{
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof bits);
+    for (int i = 0; i < 8; i++, bits >>= 8)
+        buf.push_back((unsigned char)bits);
+}
+
+void CheckpointWriter::put_bytes(const uint8_t *data, size_t n)
+{
+    buf.insert(buf.end(), data, data + n);
+}
+
+void CheckpointWriter::save(const std::string &path) const
+{
+    if (!open.empty())
+        throw std::logic_error("Checkpoint section left open");
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("Cannot create " + path);
+    unsigned char h[HEADER_BYTES] = {};
+    memcpy(h, MAGIC, 4);
+    h[4] = (unsigned char)CHECKPOINT_VERSION;
+    h[5] = (unsigned char)(CHECKPOINT_VERSION >> 8);
+    out.write(reinterpret_cast<const char *>(h), sizeof h);
+    out.write(reinterpret_cast<const char *>(buf.data()), buf.size());
+    if (!out)
+        throw std::runtime_error("Cannot write " + path);
+}
+
+/* ---------------- READER ---------------- */
+
+CheckpointReader::CheckpointReader(const std::string &path) : pos(HEADER_BYTES)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("Cannot open " + path);
+    buf.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    if (buf.size() < HEADER_BYTES || memcmp(buf.data(), MAGIC, 4) != 0)
+        throw std::runtime_error(path + " is not a checkpoint");
+    if ((buf[4] | buf[5] << 8) != CHECKPOINT_VERSION)
+        throw std::runtime_error(path + ": unsupported checkpoint version");
+}
+
+void CheckpointReader::need(size_t bytes) const
+{
+    size_t limit = ends.empty() ? buf.size() : ends.back();
+    if (bytes > limit - pos)
+        throw std::runtime_error("Checkpoint is truncated");
+}
+
+void CheckpointReader::begin(const char *tag)
+{
+    need(12);
+    if (memcmp(&buf[pos], tag, 4) != 0)
+        throw std::runtime_error("Checkpoint holds " + std::string((const char *)&buf[pos], 4) +
+                                 " where " + std::string(tag, 4) + " was expected");
+    uint64_t len = 0;
+    for (int i = 7; i >= 0; i--)
+        len = (len << 8) | buf[pos + 4 + i];
+    pos += 12;
+    need(len);
+    ends.push_back(pos + len);
+}
+
+void CheckpointReader::end()
+{
+    if (pos != ends.back())
+        throw std::runtime_error("Checkpoint section has unexpected contents");
+    ends.pop_back();
+}
+
+uint64_t CheckpointReader::get()
+{
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        need(1);
+        unsigned char b = buf[pos++];
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return v;
+    }
+    throw std::runtime_error("Checkpoint holds a malformed number");
+}
+
+int64_t CheckpointReader::get_signed()
+{
+    uint64_t v = get();
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+double CheckpointReader::get_double()
+{
+    need(8);
+    uint64_t bits = 0;
+    for (int i = 7; i >= 0; i--)
+        bits = (bits << 8) | buf[pos + i];
+    pos += 8;
+    double v;
+    memcpy(&v, &bits, sizeof v);
+    return v;
+}
+
+void CheckpointReader::get_bytes(uint8_t *data, size_t n)
+{
+    need(n);
+    memcpy(data, &buf[pos], n);
+    pos += n;
+}
+
+uint64_t CheckpointReader::get_below(uint64_t limit, const char *what)
+{
+    uint64_t v = get();
+    if (v >= limit)
+        throw std::runtime_error(std::string("Checkpoint holds a bad ") + what);
+    return v;
+}
@@ -0,0 +1,188 @@
+#include "include/concurrent_vm.h"
+#include "include/event_trace.h"
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+
+/* ---------------- FREE FRAME STACK ---------------- */
+
+FrameStack::FrameStack(size_t frames)
+    : next(frames),
+      head(0)
+{
+    for (size_t i = frames; i-- > 0;)
+        push((int)i); // lowest frame on top, handed out first
+}
+
+int FrameStack::pop()
+{
+    uint64_t h = head.load(std::memory_order_acquire);
+    while (true) {
+        int top = (int)(h & 0xffffffffu) - 1;
+        if (top < 0)
+            return -1;
+        uint64_t below = (uint64_t)(next[top].load(std::memory_order_relaxed) + 1);
+        uint64_t nh = (((h >> 32) + 1) << 32) | below;
+        if (head.compare_exchange_weak(h, nh, std::memory_order_acq_rel, std::memory_order_acquire))
+            return top;
+    }
+}
+
+void FrameStack::push(int frame)
+{
+    uint64_t h = head.load(std::memory_order_relaxed);
+    uint64_t nh;
+    do {
+        next[frame].store((int)(h & 0xffffffffu) - 1, std::memory_order_relaxed);
+        nh = (((h >> 32) + 1) << 32) | (uint64_t)(frame + 1);
+    } while (!head.compare_exchange_weak(h, nh, std::memory_order_release, std::memory_order_relaxed));
+}
+
+/* ---------------- CONCURRENT VM ---------------- */
+
+static const int OWNER_VPN_BITS = PT_LEVELS * PT_INDEX_BITS;
+
+static uint64_t pack_owner(int pid, uint64_t vpn) { return ((uint64_t)(pid + 1) << OWNER_VPN_BITS) | vpn; }
+static int owner_pid(uint64_t o) { return (int)(o >> OWNER_VPN_BITS) - 1; }
+static uint64_t owner_vpn(uint64_t o) { return o & (PT_MAX_PAGES - 1); }
+
+ConcurrentVM::ConcurrentVM(size_t frames, size_t psize)
+    : page_size(psize),
+      num_frames(frames),
+      owner(frames),
+      referenced(frames),
+      clock_hand(0),
+      free_frames(frames)
+{
+    for (size_t i = 0; i < num_frames; i++) {
+        owner[i].store(0, std::memory_order_relaxed);
+        referenced[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void ConcurrentVM::create_process(int pid, uint64_t num_pages)
+{
+    if (pid < 0)
+        throw std::out_of_range("Invalid PID");
+    if (num_pages > PT_MAX_PAGES)
+        throw std::out_of_range("Address space larger than the page table can map");
+    if ((size_t)pid >= processes.size())
+        processes.resize(pid + 1);
+    processes[pid].reset(new Proc());
+    processes[pid]->num_pages = num_pages;
+}
+
+uint64_t ConcurrentVM::translate(int pid, uint64_t va, VmShard &shard)
+{
+    SIM_PROFILE(TRANSLATE);
+    if (pid < 0 || (size_t)pid >= processes.size() || !processes[pid])
+        throw std::out_of_range("Invalid PID");
+    Proc &proc = *processes[pid];
+    uint64_t vpn = va / page_size;
+    size_t offset = va % page_size;
+    if (vpn >= proc.num_pages)
+        throw std::out_of_range("Virtual address outside the process address space");
+
+    std::lock_guard<std::mutex> guard(proc.lock);
+    int level;
+    auto &pte = proc.page_table.lookup(vpn, level);
+
+    // PAGE HIT
+    if (pte.valid) {
+        shard.hits++;
+        referenced[pte.frame].store(1, std::memory_order_relaxed);
+        return (uint64_t)pte.frame * page_size + offset;
+    }
+
+    // PAGE FAULT
+    shard.faults++;
+    SIM_EVENT(PAGE_FAULT, 0, vpn, pid);
+    int frame = free_frames.pop();
+    if (frame == -1)
+        frame = evict(pid, shard);
+
+    pte.valid = true;
+    pte.frame = frame;
+    pte.ref_bit = true;
+    pte.dirty = false;
+    pte.cow = false;
+    referenced[frame].store(1, std::memory_order_relaxed);
+    owner[frame].store(pack_owner(pid, vpn), std::memory_order_release); // sweep may pick it from now on
+    return (uint64_t)frame * page_size + offset;
+}
+
+// CLOCK sweep shared by all threads. A frame is only unmapped with its owner's lock
+// held; a busy owner is skipped instead of waited for, which rules out lock cycles
+int ConcurrentVM::evict(int self, VmShard &shard)
+{
+    while (true) {
+        size_t f = clock_hand.fetch_add(1, std::memory_order_relaxed) % num_frames;
+        uint64_t o = owner[f].load(std::memory_order_acquire);
+        if (o == 0)
+            continue; // free or being mapped right now
+        if (referenced[f].exchange(0, std::memory_order_relaxed))
+            continue; // second chance
+
+        int pid = owner_pid(o);
+        Proc &victim = *processes[pid];
+        if (pid != self && !victim.lock.try_lock()) {
+            shard.busy_skips++;
+            continue;
+        }
+        // with the owner locked the mapping can no longer change under us
+        bool still_mapped = owner[f].load(std::memory_order_relaxed) == o;
+        if (still_mapped) {
+            victim.page_table.find(owner_vpn(o))->valid = false;
+            owner[f].store(0, std::memory_order_relaxed);
+        }
+        if (pid != self)
+            victim.lock.unlock();
+        if (still_mapped) {
+            shard.evictions++;
+            SIM_EVENT(PAGE_EVICT, 0, owner_vpn(o), pid);
+            return (int)f;
+        }
+    }
+}
+
+VmShard aggregate(const std::vector<VmShard> &shards)
+{
+    VmShard total = {0, 0, 0, 0};
+    for (auto &s : shards) {
+        total.hits += s.hits;
+        total.faults += s.faults;
+        total.evictions += s.evictions;
+        total.busy_skips += s.busy_skips;
+    }
+    return total;
+}
+
+ScalePoint replay_concurrent(size_t num_frames, size_t page_size, uint64_t pages_per_process,
+                             const std::vector<std::vector<uint64_t>> &streams)
+{
+    if (num_frames == 0)
+        throw std::invalid_argument("Need at least one frame");
+    ConcurrentVM vm(num_frames, page_size);
+    uint64_t references = 0;
+    for (size_t t = 0; t < streams.size(); t++) {
+        vm.create_process((int)t, pages_per_process);
+        for (uint64_t va : streams[t])
+            if (va / page_size >= pages_per_process)
+                throw std::out_of_range("Virtual address outside the process address space");
+        references += streams[t].size();
+    }
+
+    std::vector<VmShard> shards(streams.size());
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < streams.size(); t++)
+        threads.emplace_back([&, t]() {
+            for (uint64_t va : streams[t])
+                vm.translate((int)t, va, shards[t]);
+        });
+    for (auto &th : threads)
+        th.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return {streams.size(), references, aggregate(shards), elapsed.count()};
+}
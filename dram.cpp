@@ -0,0 +1,179 @@
+#include "include/dram.h"
+#include "include/event_trace.h"
+#include <algorithm>
+#include <queue>
+#include <functional>
+#include <stdexcept>
+
+DramConfig default_dram_config()
+{
+    // DDR4-2400 CL17 seen from a 3 GHz core: ~14 ns per timing, 64 B burst in ~2.7 ns
+    return {2, 1, 8, 8192, 64, 42, 42, 42, 8, DramPagePolicy::OPEN, DramScheduler::FR_FCFS};
+}
+
+DramController::DramController(const DramConfig &cfg)
+    : config(cfg),
+      requests(0),
+      row_hits(0),
+      row_misses(0),
+      row_conflicts(0),
+      total_latency(0),
+      first_arrival(UINT64_MAX),
+      last_done(0)
+{
+    if (config.channels == 0 || config.ranks == 0 || config.banks == 0)
+        throw std::invalid_argument("DRAM needs at least one channel, rank and bank");
+    if (config.line_bytes == 0 || config.row_bytes < config.line_bytes)
+        throw std::invalid_argument("DRAM row must hold at least one line");
+    banks.assign(config.channels * config.ranks * config.banks, {-1, 0});
+    bus_ready.assign(config.channels, 0);
+}
+
+// line interleaved over channels, then the columns of a row, then banks, ranks and rows
+DramAddress DramController::map(uint64_t addr) const
+{
+    DramAddress a;
+    uint64_t line = addr / config.line_bytes;
+    a.channel = line % config.channels;
+    line /= config.channels;
+    line /= config.row_bytes / config.line_bytes;
+    a.bank = line % config.banks;
+    line /= config.banks;
+    a.rank = line % config.ranks;
+    a.row = line / config.ranks;
+    return a;
+}
+
+void DramController::enqueue(uint64_t addr, uint64_t arrival)
+{
+    queue.push_back({addr, arrival, map(addr)});
+}
+
+uint64_t DramController::ready_at(const DramRequest &r) const
+{
+    return std::max(r.arrival, banks[bank_index(r.where)].ready);
+}
+
+uint64_t DramController::issue(const DramRequest &r, uint64_t now)
+{
+    Bank &bank = banks[bank_index(r.where)];
+    uint64_t start = std::max(now, ready_at(r));
+    uint64_t command;
+    if (bank.open_row == (int64_t)r.where.row) {
+        row_hits++;
+        command = config.t_cas;
+    } else if (bank.open_row == -1) {
+        row_misses++;
+        command = config.t_rcd + config.t_cas;
+    } else {
+        row_conflicts++;
+        command = config.t_rp + config.t_rcd + config.t_cas;
+    }
+
+    // the data still has to wait for the channel bus
+    uint64_t done = std::max(start + command, bus_ready[r.where.channel]) + config.t_burst;
+    bus_ready[r.where.channel] = done;
+    if (config.page_policy == DramPagePolicy::OPEN) {
+        bank.open_row = (int64_t)r.where.row;
+        bank.ready = start + command; // next column command can follow
+    } else {
+        bank.open_row = -1;
+        bank.ready = done + config.t_rp; // precharged behind the access
+    }
+
+    requests++;
+    total_latency += done - r.arrival;
+    latency.record(done - r.arrival);
+    first_arrival = std::min(first_arrival, r.arrival);
+    last_done = std::max(last_done, done);
+    return done;
+}
+
+bool DramController::serve(uint64_t now, uint64_t &done)
+{
+    size_t pick = queue.size();
+    if (config.scheduler == DramScheduler::FCFS) {
+        if (!queue.empty() && ready_at(queue.front()) <= now)
+            pick = 0;
+    } else {
+        // first ready row hit, otherwise the oldest ready request
+        for (size_t i = 0; i < queue.size(); i++) {
+            if (ready_at(queue[i]) > now)
+                continue;
+            if (banks[bank_index(queue[i].where)].open_row == (int64_t)queue[i].where.row) {
+                pick = i;
+                break;
+            }
+            if (pick == queue.size())
+                pick = i;
+        }
+    }
+    if (pick == queue.size())
+        return false;
+    DramRequest r = queue[pick];
+    queue.erase(queue.begin() + pick);
+    done = issue(r, now);
+    return true;
+}
+
+uint64_t DramController::next_ready() const
+{
+    if (config.scheduler == DramScheduler::FCFS)
+        return ready_at(queue.front());
+    uint64_t t = UINT64_MAX;
+    for (auto &r : queue)
+        t = std::min(t, ready_at(r));
+    return t;
+}
+
+uint64_t DramController::access(uint64_t addr, uint64_t now)
+{
+    SIM_PROFILE(DRAM_ACCESS);
+    DramRequest r = {addr, now, map(addr)};
+    return issue(r, now) - now;
+}
+
+double DramController::bandwidth() const
+{
+    if (last_done <= first_arrival)
+        return 0.0;
+    return (double)(requests * config.line_bytes) / (last_done - first_arrival);
+}
+
+void DramController::register_stats(StatsRegistry &stats, const std::string &prefix) const
+{
+    stats.counter(prefix + ".requests", &requests);
+    stats.counter(prefix + ".row_hits", &row_hits);
+    stats.counter(prefix + ".row_misses", &row_misses);
+    stats.counter(prefix + ".row_conflicts", &row_conflicts);
+    stats.gauge(prefix + ".bandwidth", [this]() { return bandwidth(); });
+    stats.histogram(prefix + ".latency", &latency);
+}
+
+DramReplay replay_dram(const DramConfig &config, const std::vector<uint64_t> &addrs, size_t outstanding)
+{
+    DramController dram(config);
+    std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<uint64_t>> in_flight; // completions
+    outstanding = std::max<size_t>(outstanding, 1);
+    uint64_t now = 0;
+    size_t next = 0;
+
+    while (next < addrs.size() || dram.queued() > 0 || !in_flight.empty()) {
+        while (!in_flight.empty() && in_flight.top() <= now)
+            in_flight.pop();
+        // the core has a new miss ready as soon as a slot frees up
+        while (next < addrs.size() && dram.queued() + in_flight.size() < outstanding)
+            dram.enqueue(addrs[next++], now);
+
+        uint64_t done;
+        if (dram.serve(now, done)) {
+            in_flight.push(done);
+            continue;
+        }
+        uint64_t t = dram.queued() > 0 ? dram.next_ready() : UINT64_MAX;
+        if (!in_flight.empty())
+            t = std::min(t, in_flight.top());
+        now = std::max(now, t);
+    }
+    return {dram.last_done, dram.average_latency(), dram.row_hit_rate(), dram.bandwidth()};
+}
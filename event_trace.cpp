@@ -0,0 +1,250 @@
+#include "include/event_trace.h"
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+/* ---------------- HOST TIME ---------------- */
+
+double host_ticks_per_second()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    static const double rate = []() {
+        auto t0 = std::chrono::steady_clock::now();
+        uint64_t k0 = host_ticks();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        uint64_t k1 = host_ticks();
+        std::chrono::duration<double> d = std::chrono::steady_clock::now() - t0;
+        return (k1 - k0) / d.count();
+    }();
+    return rate;
+#else
+    return 1e9;
+#endif
+}
+
+/* ---------------- EVENT LOG ---------------- */
+
+static const char MAGIC[4] = {'M', 'M', 'E', 'V'};
+static const uint16_t VERSION = 1;
+const uint64_t RING_EVENTS = 4096; // per thread
+
+static const char *EVENT_NAMES[] = {"cache_hit", "cache_miss", "cache_evict", "page_fault",
+                                    "page_evict", "alloc_split", "alloc_merge", "alloc_fail"};
+
+std::atomic<bool> event_log_enabled(false);
+
+// single producer ring: the owning thread publishes with head, drains advance tail
+struct EventRing {
+    Event slots[RING_EVENTS];
+    std::atomic<uint64_t> head;
+    std::atomic<uint64_t> tail;
+    uint16_t thread;
+
+    EventRing();
+    ~EventRing();
+};
+
+// the file and the list of rings; held while draining, never while recording
+static std::mutex log_mutex;
+static std::ofstream log_file;
+static std::string log_path;
+static uint64_t log_events = 0;
+static std::vector<EventRing *> rings;
+static uint16_t next_thread = 0;
+
+static void store_le(unsigned char *p, uint64_t v, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        p[i] = (unsigned char)v;
+        v >>= 8;
+    }
+}
+
+static uint64_t load_le(const unsigned char *p, int bytes)
+{
+    uint64_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+// log_mutex held; without an open log the events are dropped
+static void drain(EventRing &ring)
+{
+    uint64_t head = ring.head.load(std::memory_order_acquire);
+    uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    if (log_file.is_open()) {
+        std::vector<unsigned char> buf((head - tail) * EVENT_LOG_RECORD, 0);
+        unsigned char *p = buf.data();
+        for (uint64_t i = tail; i < head; i++, p += EVENT_LOG_RECORD) {
+            const Event &e = ring.slots[i % RING_EVENTS];
+            store_le(p, e.time, 8);
+            store_le(p + 8, e.addr, 8);
+            store_le(p + 16, e.arg, 8);
+            p[24] = (unsigned char)e.type;
+            p[25] = e.unit;
+            store_le(p + 26, e.thread, 2);
+        }
+        log_file.write(reinterpret_cast<const char *>(buf.data()), buf.size());
+        log_events += head - tail;
+    }
+    ring.tail.store(head, std::memory_order_release);
+}
+
+EventRing::EventRing() : head(0), tail(0)
+{
+    std::lock_guard<std::mutex> lock(log_mutex);
+    thread = next_thread++;
+    rings.push_back(this);
+}
+
+EventRing::~EventRing()
+{
+    std::lock_guard<std::mutex> lock(log_mutex);
+    drain(*this);
+    rings.erase(std::find(rings.begin(), rings.end(), this));
+}
+
+bool events_compiled()
+{
+#ifdef TRACE_EVENTS
+    return true;
+#else
+    return false;
+#endif
+}
+
+void record_event(EventType type, uint8_t unit, uint64_t addr, uint64_t arg)
+{
+    thread_local EventRing ring;
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) == RING_EVENTS) {
+        std::lock_guard<std::mutex> lock(log_mutex);
+        drain(ring);
+    }
+    ring.slots[head % RING_EVENTS] = {host_ticks(), addr, arg, type, unit, ring.thread};
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+static void write_header(uint64_t events, uint64_t ticks_per_second)
+{
+    unsigned char h[EVENT_LOG_HEADER] = {};
+    memcpy(h, MAGIC, 4);
+    store_le(h + 4, VERSION, 2);
+    store_le(h + 6, EVENT_LOG_RECORD, 2);
+    store_le(h + 12, events, 8);
+    store_le(h + 20, ticks_per_second, 8);
+    log_file.seekp(0);
+    log_file.write(reinterpret_cast<const char *>(h), sizeof h);
+}
+
+void open_event_log(const std::string &path)
+{
+    close_event_log();
+    std::lock_guard<std::mutex> lock(log_mutex);
+    log_file.open(path, std::ios::binary | std::ios::trunc);
+    if (!log_file)
+        throw std::runtime_error("Cannot create " + path);
+    log_path = path;
+    log_events = 0;
+    write_header(0, 0); // counts filled in by close_event_log()
+    for (EventRing *r : rings)
+        r->tail.store(r->head.load(std::memory_order_acquire), std::memory_order_release); // stale events
+    event_log_enabled.store(true);
+}
+
+uint64_t close_event_log()
+{
+    event_log_enabled.store(false);
+    double rate = host_ticks_per_second();
+    std::lock_guard<std::mutex> lock(log_mutex);
+    if (!log_file.is_open())
+        return 0;
+    for (EventRing *r : rings)
+        drain(*r);
+    write_header(log_events, (uint64_t)rate);
+    bool ok = (bool)log_file;
+    log_file.close();
+    if (!ok)
+        throw std::runtime_error("Cannot write " + log_path);
+    return log_events;
+}
+
+void print_event_log(std::ostream &out, const char *data, size_t size)
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+    if (size < EVENT_LOG_HEADER || memcmp(p, MAGIC, 4) != 0)
+        throw std::runtime_error("Not an event log");
+    if (load_le(p + 4, 2) != VERSION || load_le(p + 6, 2) != EVENT_LOG_RECORD)
+        throw std::runtime_error("Unsupported event log version");
+    uint64_t events = load_le(p + 12, 8);
+    double rate = (double)load_le(p + 20, 8);
+    if (events > (size - EVENT_LOG_HEADER) / EVENT_LOG_RECORD)
+        throw std::runtime_error("Event log is truncated");
+    const unsigned char *first = p + EVENT_LOG_HEADER;
+
+    // times relative to the earliest event of any thread
+    uint64_t t0 = UINT64_MAX;
+    for (uint64_t i = 0; i < events; i++)
+        t0 = std::min(t0, load_le(first + i * EVENT_LOG_RECORD, 8));
+    out << "ns,thread,event,unit,addr,arg\n";
+    for (uint64_t i = 0; i < events; i++) {
+        const unsigned char *r = first + i * EVENT_LOG_RECORD;
+        unsigned type = r[24];
+        out << (uint64_t)((load_le(r, 8) - t0) * 1e9 / (rate > 0 ? rate : 1e9)) << "," << load_le(r + 26, 2) << ","
+            << (type < sizeof EVENT_NAMES / sizeof *EVENT_NAMES ? EVENT_NAMES[type] : "unknown") << ","
+            << (unsigned)r[25] << "," << load_le(r + 8, 8) << "," << load_le(r + 16, 8) << "\n";
+    }
+}
+
+/* ---------------- PROFILING ---------------- */
+
+ProfileCounter profile_counters[(int)ProfileScope::COUNT];
+
+static const char *SCOPE_NAMES[] = {"cache.access", "vm.translate", "buddy.allocate", "buddy.free",
+                                    "heap.allocate", "heap.free", "dram.access"};
+
+bool profile_compiled()
+{
+#ifdef HOST_PROFILE
+    return true;
+#else
+    return false;
+#endif
+}
+
+void reset_profile()
+{
+    for (ProfileCounter &c : profile_counters) {
+        c.calls.store(0);
+        c.ticks.store(0);
+    }
+}
+
+static double scope_ns(const ProfileCounter &c) { return c.ticks.load() * 1e9 / host_ticks_per_second(); }
+
+void print_profile(std::ostream &out)
+{
+    for (int s = 0; s < (int)ProfileScope::COUNT; s++) {
+        const ProfileCounter &c = profile_counters[s];
+        uint64_t calls = c.calls.load();
+        if (calls == 0)
+            continue;
+        double ns = scope_ns(c);
+        out << "Host time " << SCOPE_NAMES[s] << ": " << calls << " calls, " << ns / 1e6 << " ms, "
+            << ns / calls << " ns/call\n";
+    }
+}
+
+void register_profile(StatsRegistry &stats, const std::string &prefix)
+{
+    for (int s = 0; s < (int)ProfileScope::COUNT; s++) {
+        const ProfileCounter *c = &profile_counters[s];
+        stats.gauge(prefix + "." + SCOPE_NAMES[s] + ".calls", [c]() { return (double)c->calls.load(); });
+        stats.gauge(prefix + "." + SCOPE_NAMES[s] + ".ns", [c]() { return scope_ns(*c); });
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <string>
+#include <memory>
+#include <cstddef>
+#include "stats.h"
+
+enum class AllocatorKind {
+    BUDDY,
+    FIRST_FIT, // PhysicalMemory
+    BEST_FIT,
+    WORST_FIT
+};
+
+const char *allocator_name(AllocatorKind kind); // buddy, first_fit, best_fit, worst_fit
+AllocatorKind parse_allocator(const std::string &name); // throws std::invalid_argument
+
+// One interface over BuddyAllocator (handles are addresses, out of memory throws) and
+// PhysicalMemory (handles are block ids, out of memory returns -1), so one allocation
+// trace can drive either
+class Allocator {
+public:
+    virtual ~Allocator() {}
+    virtual AllocatorKind kind() const = 0;
+
+    // false when out of memory, otherwise handle names the block for deallocate
+    virtual bool allocate(size_t size, size_t &handle) = 0;
+    virtual void deallocate(size_t handle) = 0; // a live handle from allocate
+
+    virtual size_t capacity() const = 0; // bytes managed
+    virtual size_t free_size() const = 0;
+    virtual size_t largest_free_block() const = 0;
+
+    virtual void register_stats(StatsRegistry &stats, const std::string &prefix) const = 0;
+    virtual void checkpoint(CheckpointWriter &out) const = 0;
+    virtual void restore(CheckpointReader &in) = 0; // throws std::runtime_error
+};
+
+// throws std::invalid_argument if memory (and min_block for the buddy allocator) cannot be managed
+std::unique_ptr<Allocator> make_allocator(AllocatorKind kind, size_t memory, size_t min_block);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef BACKING_STORE_H
+#define BACKING_STORE_H
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+class CheckpointWriter;
+class CheckpointReader;
+
+// swap slot owner: pages are keyed by (pid, vpn) so processes never share a slot
+struct SwapKey {
+    int pid;
+    uint64_t vpn;
+    bool operator==(const SwapKey &o) const { return pid == o.pid && vpn == o.vpn; }
+};
+
+struct SwapKeyHash {
+    size_t operator()(const SwapKey &k) const
+    {
+        return std::hash<uint64_t>()(k.vpn * 0x9E3779B97F4A7C15ULL ^ (uint64_t)(uint32_t)k.pid);
+    }
+};
+
+// Swap space for VirtualMemory. Slots are created on the first page out of a page,
+// pages that were never written out read back as zeros. Slots live either in host
+// memory or in a sparse, memory mapped swap file.
+class BackingStore {
+private:
+    size_t page_size;
+    std::unordered_map<SwapKey, size_t, SwapKeyHash> slots; // (pid, vpn) -> slot number
+    std::vector<std::vector<uint8_t>> memory_slots; // used when there is no swap file
+
+    std::string path; // swap file, empty when slots live in memory
+    int fd;
+    uint8_t *mapping;
+    size_t capacity; // slots covered by the current mapping
+
+    uint8_t *slot_data(size_t slot);
+    void grow_file(size_t min_slots);
+
+public:
+    BackingStore(size_t page_size);
+    ~BackingStore();
+    BackingStore(const BackingStore &) = delete;
+    BackingStore &operator=(const BackingStore &) = delete;
+
+    // move the store into a sparse swap file, only allowed while it is empty
+    // throws std::runtime_error if the file cannot be created or mapped
+    void use_file(const std::string &file);
+
+    void write(int pid, uint64_t vpn, const uint8_t *data);
+    bool read(int pid, uint64_t vpn, uint8_t *data); // false (and zero fill) if never written
+    void copy_process(int from, int to); // fork: every slot of from duplicated for to
+
+    // every slot in slot order, all-zero pages without their bytes; restore only into an empty store
+    void checkpoint(CheckpointWriter &out);
+    void restore(CheckpointReader &in); // throws std::runtime_error
+
+    size_t pages() const { return slots.size(); }
+    size_t bytes() const { return slots.size() * page_size; }
+    const std::string &file() const { return path; }
+};
+
+#endif
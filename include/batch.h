@@ -0,0 +1,144 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <string>
+#include <ostream>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "cache.h"
+#include "virtual_memory.h"
+#include "allocator.h"
+#include "dram.h"
+#include "trace.h"
+#include "binary_trace.h"
+#include "workload.h"
+#include "stats.h"
+
+enum class BatchMode {
+    CACHE, // trace of physical addresses through L1 / L2 / L3
+    VM,    // trace of (pid, virtual address) through the TLB, page tables and caches
+    ALLOC  // alloc / free records through the buddy allocator or the contiguous allocator
+};
+
+// where the references come from
+enum class BatchWorkload {
+    TRACE,      // --trace file
+    ADDRESSES,  // AddressGenerator
+    ALLOCATIONS // AllocationGenerator
+};
+
+// everything a batch run can be configured with, "key = value" in a config file
+struct BatchConfig {
+    BatchMode mode;
+
+    // caches (same defaults as the VM menu)
+    size_t block_size;
+    size_t cache_size[3];
+    size_t cache_ways[3];
+    uint64_t cache_latency[3];
+    size_t cache_victim[3]; // victim cache entries, 0 = none
+    ReplacementPolicy cache_policy;
+    uint64_t ram_latency; // flat LLC miss cost without the DRAM model
+    bool dram;
+    DramConfig dram_config;
+
+    // virtual memory
+    size_t processes; // pids 0 .. processes - 1
+    uint64_t pages; // per process
+    size_t frames;
+    size_t page_size;
+    PageReplacement policy; // OPT reads the trace twice
+    bool tlb;
+    size_t readahead; // max window in pages, 0 = off
+    bool thp;
+    size_t numa_nodes; // 0 = no NUMA
+    uint64_t numa_local;
+    uint64_t numa_remote;
+    uint64_t numa_migrate; // remote references before a page moves, 0 = off
+
+    // allocator
+    AllocatorKind allocator;
+    size_t memory;
+    size_t min_block; // buddy
+
+    BatchWorkload workload;
+    AddressWorkload addresses;
+    AllocationWorkload allocations;
+
+    // checkpoint files, "" = none: restore is loaded before the replay, checkpoint written after it
+    std::string restore;
+    std::string checkpoint;
+};
+
+BatchConfig default_batch_config();
+void set_option(BatchConfig &cfg, const std::string &key, const std::string &value); // throws std::invalid_argument
+void load_config(BatchConfig &cfg, const std::string &path); // throws std::runtime_error / std::invalid_argument
+
+// aggregated counters of one run
+struct BatchResult {
+    uint64_t references;
+    uint64_t cache_hits[3];
+    uint64_t cache_misses[3];
+    uint64_t victim_hits[3]; // of cache_hits, the ones served by the victim cache
+    uint64_t ram_accesses;
+    uint64_t total_cycles;
+
+    // VM mode
+    uint64_t page_hits;
+    uint64_t page_faults;
+    uint64_t major_faults;
+    uint64_t writebacks;
+    uint64_t tlb_hits; // dTLB + STLB
+    uint64_t tlb_misses;
+    uint64_t page_walks;
+    uint64_t translation_cycles;
+    uint64_t fault_cycles;
+
+    // DRAM model
+    uint64_t row_hits;
+    uint64_t row_misses;
+    uint64_t row_conflicts;
+    double dram_latency; // average
+
+    // ALLOC mode
+    uint64_t allocations;
+    uint64_t alloc_failures; // out of memory
+    uint64_t frees;
+    uint64_t requested_bytes; // live at the end
+    uint64_t allocated_bytes; // live at the end, whole blocks
+    uint64_t peak_bytes; // most block bytes live at once
+    size_t free_bytes;
+    size_t largest_free;
+
+    uint64_t skipped; // records the mode has no use for (alloc / free in an access trace and back)
+    double seconds; // wall clock of the replay
+};
+
+// parser for a trace file already in memory: binary by its header, else text or lackey (format)
+std::unique_ptr<TraceSource> open_trace(const char *data, size_t size, const std::string &format, const BatchConfig &cfg);
+
+// the generator cfg.workload asks for, VM references are spread over cfg.processes
+std::unique_ptr<TraceSource> make_workload(const BatchConfig &cfg); // throws std::invalid_argument
+
+// replay a whole trace, throws std::runtime_error naming the reference that failed;
+// with stats, the registry of the run is exported every stats->every references and at the end
+BatchResult run_trace(const BatchConfig &cfg, TraceSource &trace, StatsOutput *stats = nullptr);
+void print_result(std::ostream &out, const BatchConfig &cfg, const BatchResult &r);
+
+// one allocation trace through several allocators in a single pass; every `every` records
+// and at the end one CSV row per allocator: live and free bytes, utilization, internal and
+// external fragmentation, failures and host ns per allocate / deallocate since the last row
+void compare_allocators(const BatchConfig &cfg, TraceSource &trace, const std::vector<AllocatorKind> &kinds,
+                        uint64_t every, std::ostream &out);
+
+// simulator --mode cache|vm|alloc [--trace <file> [--format text|lackey]] [--config <file>] [--set key=value ...]
+//           [--convert <file> [--encoding fixed|delta]] [--sweep key=values ... [--threads <n>] [--csv <file>]]
+//           [--stats <file> [--stats-format json|csv] [--stats-every <n>]] [--events <file>]
+//           [--compare <allocators> [--compare-every <n>] [--csv <file>]]
+// simulator --print-events <file>
+// without --trace the references come from the workload = ... generator
+int run_batch(int argc, char **argv);
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef BINARY_TRACE_H
+#define BINARY_TRACE_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <cstddef>
+#include "trace.h"
+
+// Binary trace file, little-endian:
+//     header  "MMTR" | u16 version | u16 encoding | u32 block records | u64 records | u64 reserved
+// FIXED: 16 bytes per record, addr u64 | size u32 | pid u16 | op u8 | 0
+// DELTA: blocks of up to `block records` records, each decodable on its own:
+//     u32 records | u32 payload bytes | payload
+//   a record is one tag byte (op in bits 0-2, bit 3 = new pid, bit 4 = new size) followed by
+//   the pid and size as varints when they changed and the zigzag varint address delta
+//   (addresses restart from 0 and pid 0 / size 0 at every block)
+enum class TraceEncoding : uint16_t {
+    FIXED = 0,
+    DELTA = 1
+};
+
+const size_t BINARY_TRACE_HEADER = 32;
+const size_t BINARY_TRACE_RECORD = 16; // FIXED
+
+bool is_binary_trace(const char *data, size_t size);
+
+// replays straight out of the mapped file, nothing is copied
+class BinaryTrace : public TraceSource {
+private:
+    const unsigned char *begin; // first record / block
+    const unsigned char *end;
+    const unsigned char *cur;
+    TraceEncoding encoding;
+    uint64_t total; // records in the file
+
+    // DELTA: state of the current block
+    const unsigned char *block_end;
+    uint32_t block_left;
+    TraceRecord prev;
+
+    bool next_block();
+
+public:
+    BinaryTrace(const char *data, size_t size); // throws std::runtime_error
+
+    bool next(TraceRecord &r) override;
+    void rewind() override;
+    uint64_t records() const { return total; }
+    TraceEncoding trace_encoding() const { return encoding; }
+};
+
+class BinaryTraceWriter {
+private:
+    std::ofstream out;
+    std::string path;
+    TraceEncoding encoding;
+    uint32_t block_records;
+    uint64_t total;
+
+    std::vector<unsigned char> block; // DELTA payload being built
+    uint32_t in_block;
+    TraceRecord prev;
+
+    void flush_block();
+
+public:
+    BinaryTraceWriter(const std::string &path, TraceEncoding encoding, uint32_t block_records = 4096); // throws std::runtime_error
+    ~BinaryTraceWriter();
+
+    void write(const TraceRecord &r); // throws std::out_of_range for a pid that does not fit 16 bits
+    void close(); // writes the record count, throws std::runtime_error on an I/O error
+    uint64_t records() const { return total; }
+};
+
+#endif
@@ -3,7 +3,9 @@
 
     #include <map>
     #include <set>
+    #include <string>
     #include <cstddef>
+    #include "stats.h"
 
     class BuddyAllocator {
     private:
@@ -24,6 +26,16 @@
         size_t allocate(size_t size);
         void deallocate(size_t addr);
         void dump() const;
+
+        size_t free_size() const; // bytes in free blocks
+        size_t largest_free_block() const; // 0 if nothing is free
+
+        Histogram request_sizes; // bytes asked for, failed requests included
+        void register_stats(StatsRegistry &stats, const std::string &prefix) const;
+
+        // free lists and live blocks, section BUDY; restore needs the same sizes
+        void checkpoint(CheckpointWriter &out) const;
+        void restore(CheckpointReader &in); // throws std::runtime_error
     };
 
     #endif
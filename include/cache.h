@@ -3,11 +3,17 @@
 
 #include <vector>
 #include <cstdint>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <ostream>
+#include "stats.h"
 
 enum class ReplacementPolicy {
     FIFO,
     LRU,
-    LFU
+    LFU,
+    ADAPTIVE // Cache only: set dueling between LRU and LFU
 };
 
 struct CacheLine {
@@ -18,6 +24,32 @@ struct CacheLine {
     uint64_t frequency;    // LFU
 };
 
+// line evicted from the sets into the victim cache
+struct VictimLine {
+    bool valid;
+    uint64_t block; // address / block size
+    uint64_t last_used; // LRU inside the victim cache
+    uint64_t frequency; // carried back into the set on a victim hit
+};
+
+// ADAPTIVE: in every DUEL_PERIOD sets one leader set always uses LRU and one LFU; misses in
+// the leaders move a PSEL_BITS saturating counter and the other sets follow the policy that misses less
+const size_t DUEL_PERIOD = 32;
+const unsigned PSEL_MAX = (1u << 10) - 1;
+
+#ifdef CACHE_INSTRUMENT
+// reuse distance buckets: 0, 1, 2-3, 4-7, 8-15, 16-31, 32+ and a last one for misses
+const int REUSE_BUCKETS = 8;
+
+// per set / per region counters, only compiled in with make INSTRUMENT=1
+struct AccessCounters {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t reuse[REUSE_BUCKETS]; // hits by LRU stack distance inside the set
+};
+#endif
+
 class Cache {
 private:
     size_t cache_size; // total cache size
@@ -37,11 +69,29 @@ private:
     int find_fifo_victim(size_t set_index); // if FIFO is used the victim to evict
     int find_lru_victim(size_t set_index);  // if LRU is used the victim to evict
     int find_lfu_victim(size_t set_index); // if LFU is used the victim to evict
+    int find_victim(size_t set_index); // by the policy of the set
+
+    unsigned psel; // ADAPTIVE: LRU leader misses count up, LFU leader misses down
+    ReplacementPolicy set_policy(size_t set_index) const; // policy a set replaces with now
+    void duel(size_t set_index); // a miss in set_index
+
+    std::vector<VictimLine> victims; // fully associative, LRU, empty without a victim cache
+    void victim_insert(const CacheLine &line, size_t set_index);
+
+#ifdef CACHE_INSTRUMENT
+    size_t region_size; // bytes per address region
+    std::vector<AccessCounters> set_stats; // one entry per set
+    std::map<uint64_t, AccessCounters> region_stats; // region number -> counters
+    AccessCounters &region_counters(uint64_t address);
+    size_t stack_distance(size_t set_index, const CacheLine &line) const;
+#endif
 
 public:
     uint64_t hits;
     uint64_t misses;
     uint64_t total_cycles; // total latency in terms of cycles 
+    uint64_t victim_hits; // of hits, the ones served by the victim cache
+    uint8_t event_unit; // tags the SIM_EVENTs of this cache (batch replay: 1 = L1, 2 = L2, 3 = L3)
 
     Cache(size_t cache_size,
           size_t block_size,
@@ -51,6 +101,26 @@ public:
 
     bool access(uint64_t address);
     uint64_t latency() const { return hit_latency; }
+    ReplacementPolicy replacement() const { return policy; }
+
+    // small fully associative cache for lines evicted from the sets, 0 entries = none;
+    // a hit there swaps the line back (one extra cycle) and counts in hits and victim_hits
+    void set_victim_cache(size_t entries);
+    size_t victim_entries() const { return victims.size(); }
+    bool lfu_winning() const { return psel > PSEL_MAX / 2; } // ADAPTIVE: followers use LFU
+    void register_stats(StatsRegistry &stats, const std::string &prefix) const;
+
+    // lines with their policy metadata, the victim cache and the counters, section CACH; restore
+    // needs the same size, block size, associativity and victim cache entries (the policy may
+    // differ), throws std::runtime_error
+    void checkpoint(CheckpointWriter &out) const;
+    void restore(CheckpointReader &in);
+
+    // instrumentation dumps (heatmap ready csv), no-ops unless built with INSTRUMENT=1
+    static bool instrumented();
+    void set_region_size(size_t bytes);
+    void dump_set_stats(std::ostream &out, const char *level, bool header) const;
+    void dump_region_stats(std::ostream &out, const char *level, bool header) const;
 };
 
 #endif
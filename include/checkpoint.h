@@ -0,0 +1,58 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Checkpoint file:
+//     header   "MMCK" | u16 version | u16 0
+//     sections 4 byte tag | u64 payload bytes | payload, one per saved object in save order
+// payload integers are LEB128 varints (signed ones zigzag coded), doubles 8 bytes, all little-endian
+const uint16_t CHECKPOINT_VERSION = 2;
+
+class CheckpointWriter {
+private:
+    std::vector<unsigned char> buf;
+    std::vector<size_t> open; // offsets of the length fields of unfinished sections
+
+public:
+    void begin(const char *tag); // 4 characters
+    void end();
+
+    void put(uint64_t v);
+    void put_signed(int64_t v);
+    void put_bool(bool v) { put(v ? 1 : 0); }
+    void put_double(double v);
+    void put_bytes(const uint8_t *data, size_t n);
+
+    void save(const std::string &path) const; // throws std::runtime_error
+};
+
+// every get throws std::runtime_error on a truncated or malformed file
+class CheckpointReader {
+private:
+    std::vector<unsigned char> buf;
+    size_t pos;
+    std::vector<size_t> ends; // end offsets of the open sections
+
+    void need(size_t bytes) const;
+
+public:
+    explicit CheckpointReader(const std::string &path); // throws std::runtime_error
+
+    void begin(const char *tag); // throws if the next section is not tag
+    void end(); // throws if the section was not read exactly
+    bool done() const { return pos == buf.size(); }
+
+    uint64_t get();
+    int64_t get_signed();
+    bool get_bool() { return get() != 0; }
+    double get_double();
+    void get_bytes(uint8_t *data, size_t n);
+    // get() that must be below limit (sizes, enum values, indices)
+    uint64_t get_below(uint64_t limit, const char *what);
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef CONCURRENT_VM_H
+#define CONCURRENT_VM_H
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include "page_table.h"
+
+// per thread counters, one cache line each so threads never write to a shared line
+struct alignas(64) VmShard {
+    uint64_t hits;
+    uint64_t faults;
+    uint64_t evictions;
+    uint64_t busy_skips; // victims passed over because their process was locked
+};
+
+// lock-free stack of free frames (Treiber stack). The head packs a tag with the
+// top frame and the tag changes on every update, so a stale compare_exchange fails (ABA)
+class FrameStack {
+private:
+    std::vector<std::atomic<int>> next;
+    std::atomic<uint64_t> head; // tag << 32 | (frame + 1), 0 in the low half = empty
+
+public:
+    FrameStack(size_t frames); // all frames free, frame 0 on top
+    int pop(); // -1 if empty
+    void push(int frame);
+};
+
+// Thread-safe address translation, one trace stream per process per thread:
+// - every process has its own page table behind its own mutex
+// - free frames come from a lock-free stack
+// - replacement is CLOCK with atomic reference bits and an atomic hand; the sweep
+//   only try_locks the owner of a victim, so two faulting threads never wait on each other
+// - counters go to the caller's shard and are summed afterwards
+// Base pages and CLOCK only: no TLB, swap, huge pages or sharing.
+class ConcurrentVM {
+private:
+    struct Proc {
+        std::mutex lock;
+        PageTable page_table;
+        uint64_t num_pages;
+    };
+
+    size_t page_size;
+    size_t num_frames;
+    std::vector<std::unique_ptr<Proc>> processes;
+
+    std::vector<std::atomic<uint64_t>> owner; // frame -> (pid + 1) << 36 | vpn, 0 = free
+    std::vector<std::atomic<uint8_t>> referenced; // CLOCK reference bit per frame
+    std::atomic<uint64_t> clock_hand;
+    FrameStack free_frames;
+
+    int evict(int self, VmShard &shard); // frame taken from some process, self is already locked
+
+public:
+    ConcurrentVM(size_t num_frames, size_t page_size);
+
+    void create_process(int pid, uint64_t num_pages); // not thread-safe, before any translate
+    // thread-safe; throws std::out_of_range on bad pid / address
+    uint64_t translate(int pid, uint64_t virtual_address, VmShard &shard);
+};
+
+VmShard aggregate(const std::vector<VmShard> &shards);
+
+// one replay: stream t is process t on thread t, all sharing the frames
+struct ScalePoint {
+    size_t threads;
+    uint64_t references;
+    VmShard totals;
+    double seconds; // wall clock
+};
+
+ScalePoint replay_concurrent(size_t num_frames, size_t page_size, uint64_t pages_per_process,
+                             const std::vector<std::vector<uint64_t>> &streams);
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef DRAM_H
+#define DRAM_H
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include "stats.h"
+
+// what a bank does with its row after an access
+enum class DramPagePolicy {
+    OPEN,  // keep the row open: next access to it is a row hit, another row a conflict
+    CLOSED // precharge right away: every access activates, but never waits for a precharge
+};
+
+enum class DramScheduler {
+    FCFS,   // oldest request first
+    FR_FCFS // oldest row hit first, then oldest request
+};
+
+// timings are in CPU cycles
+struct DramConfig {
+    size_t channels;
+    size_t ranks; // per channel
+    size_t banks; // per rank
+    size_t row_bytes; // row buffer of a bank
+    size_t line_bytes; // bytes moved per request (cache block)
+    uint64_t t_cas; // column access, row already open
+    uint64_t t_rcd; // row activate
+    uint64_t t_rp; // precharge (close the open row)
+    uint64_t t_burst; // data transfer on the channel bus
+    DramPagePolicy page_policy;
+    DramScheduler scheduler;
+};
+
+DramConfig default_dram_config(); // 2 channels x 1 rank x 8 banks, 8 KiB rows, DDR4-like timings
+
+// where a physical address lives; consecutive lines alternate between channels and
+// then fill a row, so a sequential stream keeps hitting open rows
+struct DramAddress {
+    size_t channel;
+    size_t rank;
+    size_t bank;
+    uint64_t row;
+};
+
+struct DramRequest {
+    uint64_t addr;
+    uint64_t arrival; // cycle the request reached the controller
+    DramAddress where;
+};
+
+// memory controller with per bank row buffers, a request queue and a channel bus per channel
+class DramController {
+private:
+    struct Bank {
+        int64_t open_row; // -1 = precharged
+        uint64_t ready; // cycle the bank can take the next command
+    };
+
+    DramConfig config;
+    std::vector<Bank> banks; // channel x rank x bank
+    std::vector<uint64_t> bus_ready; // per channel
+    std::deque<DramRequest> queue; // arrival order
+
+    size_t bank_index(const DramAddress &a) const { return (a.channel * config.ranks + a.rank) * config.banks + a.bank; }
+    uint64_t ready_at(const DramRequest &r) const; // first cycle r could be issued
+    uint64_t issue(const DramRequest &r, uint64_t now); // completion cycle
+
+public:
+    uint64_t requests;
+    uint64_t row_hits; // row already open
+    uint64_t row_misses; // bank precharged, activate only
+    uint64_t row_conflicts; // other row open, precharge + activate
+    uint64_t total_latency; // sum of arrival -> data
+    uint64_t first_arrival;
+    uint64_t last_done;
+    Histogram latency; // arrival -> data per request
+
+    DramController(const DramConfig &config); // throws std::invalid_argument
+
+    DramAddress map(uint64_t addr) const;
+    void enqueue(uint64_t addr, uint64_t arrival);
+    // issue one queued request whose bank is ready at now, picked by the scheduler;
+    // false if there is none (FCFS only ever looks at the oldest request)
+    bool serve(uint64_t now, uint64_t &done);
+    uint64_t next_ready() const; // earliest cycle serve() can succeed, queue not empty
+    size_t queued() const { return queue.size(); }
+    // one blocking request (the simulators stall on a miss): latency in cycles
+    uint64_t access(uint64_t addr, uint64_t now);
+
+    const DramConfig &configuration() const { return config; }
+    double row_hit_rate() const { return requests ? (double)row_hits / requests : 0.0; }
+    double average_latency() const { return requests ? (double)total_latency / requests : 0.0; }
+    double bandwidth() const; // bytes per cycle from the first arrival to the last completion
+    void register_stats(StatsRegistry &stats, const std::string &prefix) const;
+};
+
+// replay of physical addresses with up to `outstanding` requests in flight (memory level parallelism)
+struct DramReplay {
+    uint64_t cycles; // until the last request completes
+    double average_latency;
+    double row_hit_rate;
+    double bandwidth; // bytes per cycle
+};
+
+DramReplay replay_dram(const DramConfig &config, const std::vector<uint64_t> &addrs, size_t outstanding);
+
+#endif
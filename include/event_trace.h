@@ -0,0 +1,135 @@
+#ifndef EVENT_TRACE_H
+#define EVENT_TRACE_H
+
+#include <string>
+#include <ostream>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "stats.h"
+
+// Trace points and host-time profiling of the simulator itself, both compiled out by default:
+//     make EVENTS=1    SIM_EVENT(...) records the decisions of the engines into a binary event log
+//     make PROFILE=1   SIM_PROFILE(...) times the enclosing scope (rdtsc on x86, steady_clock elsewhere)
+// Without the flags the macros expand to nothing.
+
+enum class EventType : uint8_t {
+    CACHE_HIT,   // addr = address, arg = set
+    CACHE_MISS,  // addr = address, arg = set
+    CACHE_EVICT, // addr = first byte of the evicted line, arg = set
+    PAGE_FAULT,  // addr = vpn, arg = pid
+    PAGE_EVICT,  // addr = vpn of the victim, arg = its pid
+    ALLOC_SPLIT, // addr = start of the free half / rest, arg = its order (buddy) or bytes (contiguous)
+    ALLOC_MERGE, // addr = start of the merged block, arg = its order (buddy) or bytes (contiguous)
+    ALLOC_FAIL   // addr = requested bytes
+};
+
+// unit of the allocator events; cache events carry Cache::event_unit, page events 0
+const uint8_t EVENT_UNIT_BUDDY = 0;
+const uint8_t EVENT_UNIT_HEAP = 1;
+
+// Event log file, little-endian:
+//     header  "MMEV" | u16 version | u16 record bytes | u32 0 | u64 events | u64 ticks per second | u64 0
+//     record  time u64 | addr u64 | arg u64 | type u8 | unit u8 | thread u16 | u32 0
+// records of one thread are in order, merge threads by time
+const size_t EVENT_LOG_HEADER = 40;
+const size_t EVENT_LOG_RECORD = 32;
+
+struct Event {
+    uint64_t time; // host ticks
+    uint64_t addr;
+    uint64_t arg;
+    EventType type;
+    uint8_t unit;
+    uint16_t thread;
+};
+
+inline uint64_t host_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+double host_ticks_per_second(); // measured once against steady_clock
+
+/* ---------------- EVENT LOG ---------------- */
+
+bool events_compiled();
+// Every thread appends to its own ring buffer without locks; a full ring is written out
+// by its thread, the rest at close. Throws std::runtime_error if the file cannot be created.
+void open_event_log(const std::string &path);
+uint64_t close_event_log(); // events written
+
+extern std::atomic<bool> event_log_enabled;
+void record_event(EventType type, uint8_t unit, uint64_t addr, uint64_t arg);
+
+// one line per event: time, thread, type, unit, addr, arg; throws std::runtime_error for a bad file
+void print_event_log(std::ostream &out, const char *data, size_t size);
+
+#ifdef TRACE_EVENTS
+#define SIM_EVENT(type, unit, addr, arg)                                                  \
+    do {                                                                                  \
+        if (event_log_enabled.load(std::memory_order_relaxed))                            \
+            record_event(EventType::type, (uint8_t)(unit), (uint64_t)(addr), (uint64_t)(arg)); \
+    } while (0)
+#else
+#define SIM_EVENT(type, unit, addr, arg) ((void)0)
+#endif
+
+/* ---------------- PROFILING ---------------- */
+
+// engine operations timed by SIM_PROFILE, inclusive of the operations they call
+enum class ProfileScope : uint8_t {
+    CACHE_ACCESS,
+    TRANSLATE,
+    BUDDY_ALLOCATE,
+    BUDDY_FREE,
+    HEAP_ALLOCATE,
+    HEAP_FREE,
+    DRAM_ACCESS,
+    COUNT
+};
+
+struct ProfileCounter {
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> ticks;
+};
+
+extern ProfileCounter profile_counters[(int)ProfileScope::COUNT];
+
+class ProfileTimer {
+private:
+    ProfileCounter &counter;
+    uint64_t start;
+
+public:
+    explicit ProfileTimer(ProfileScope scope) : counter(profile_counters[(int)scope]), start(host_ticks()) {}
+    ~ProfileTimer()
+    {
+        counter.ticks.fetch_add(host_ticks() - start, std::memory_order_relaxed);
+        counter.calls.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+bool profile_compiled();
+void reset_profile();
+// calls, host ns and ns per call of every scope that ran
+void print_profile(std::ostream &out);
+void register_profile(StatsRegistry &stats, const std::string &prefix);
+
+#ifdef HOST_PROFILE
+#define SIM_PROFILE_CONCAT2(a, b) a##b
+#define SIM_PROFILE_CONCAT(a, b) SIM_PROFILE_CONCAT2(a, b)
+#define SIM_PROFILE(scope) ProfileTimer SIM_PROFILE_CONCAT(sim_profile_, __LINE__)(ProfileScope::scope)
+#else
+#define SIM_PROFILE(scope) ((void)0)
+#endif
+
+#endif
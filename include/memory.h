@@ -2,7 +2,9 @@
 #define MEMORY_H
 
 #include <list>
+#include <string>
 #include <cstddef>
+#include "stats.h"
 
 struct Block
 {
@@ -26,6 +28,16 @@ public:
     int allocate_worst_fit(size_t req_size);
     void deallocate(int id);
     void dump() const;
+
+    size_t free_size() const;          // bytes in free blocks
+    size_t largest_free_block() const; // 0 if nothing is free
+
+    Histogram request_sizes; // bytes asked for, failed requests included
+    void register_stats(StatsRegistry &stats, const std::string &prefix) const;
+
+    // block list and next id, section HEAP; restore needs the same size
+    void checkpoint(CheckpointWriter &out) const;
+    void restore(CheckpointReader &in); // throws std::runtime_error
 };
 
 #endif
@@ -0,0 +1,33 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// where a process' new pages are placed
+enum class NumaPolicy {
+    LOCAL,      // the node the process runs on, nearest other node when it is full
+    INTERLEAVE, // round robin over all nodes
+    PREFERRED   // one chosen node, nearest other node when it is full
+};
+
+// NUMA machine: the frames are split into one contiguous range per node and the
+// cost of a memory access depends on the CPU node and the memory node (distance matrix)
+class NumaTopology {
+private:
+    size_t num_nodes;
+    size_t frames_per_node; // the last node also gets the remainder
+    std::vector<uint64_t> distance; // num_nodes x num_nodes, cycles from CPU node (row) to memory node
+
+public:
+    NumaTopology(size_t nodes, size_t num_frames, uint64_t local_latency, uint64_t remote_latency);
+
+    size_t nodes() const { return num_nodes; }
+    int node_of(int frame) const;
+    uint64_t latency(int cpu_node, int memory_node) const { return distance[cpu_node * num_nodes + memory_node]; }
+    void set_latency(int cpu_node, int memory_node, uint64_t cycles); // throws std::out_of_range
+    std::vector<int> fallback_order(int node) const; // every node by latency from node, node itself first
+};
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef PAGE_TABLE_H
+#define PAGE_TABLE_H
+
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+class CheckpointWriter;
+class CheckpointReader;
+
+// x86-64 style radix page table: 4 levels with 9 index bits each,
+// so a process can address 2^36 virtual pages (48 bit VA with 4 KiB pages)
+const int PT_LEVELS = 4;
+const int PT_INDEX_BITS = 9;
+const size_t PT_ENTRIES = size_t(1) << PT_INDEX_BITS;
+const uint64_t PT_MAX_PAGES = uint64_t(1) << (PT_LEVELS * PT_INDEX_BITS);
+const size_t PT_ENTRY_BYTES = 8; // size of a hardware PTE, used for overhead reporting
+
+// a valid entry above the last level maps a huge page directly:
+// level 2 = 512 base pages (2 MiB with 4 KiB pages), level 3 = 512 * 512 (1 GiB)
+const int HUGE_2M_LEVEL = 2;
+const int HUGE_1G_LEVEL = 3;
+inline uint64_t pages_at_level(int level) { return uint64_t(1) << ((level - 1) * PT_INDEX_BITS); }
+
+struct PageTableEntry {
+    bool valid;
+    int frame;
+    uint64_t arrival;
+    uint64_t last_used;
+    bool ref_bit;
+    bool dirty; // written since it was paged in
+    bool cow; // frame shared read-only, the first write copies it
+};
+
+// one table of the radix tree, leaves live in entries[] of the last level
+// (or of a higher level for huge pages)
+struct PageTableNode {
+    PageTableEntry entries[PT_ENTRIES];
+    std::unique_ptr<PageTableNode> children[PT_ENTRIES];
+
+    PageTableNode();
+};
+
+class PageTable {
+private:
+    std::unique_ptr<PageTableNode> root;
+    size_t num_nodes; // tables allocated so far (root included)
+
+    static size_t index(uint64_t vpn, int level); // index bits of vpn for a level (PT_LEVELS = root)
+    static size_t subtree_nodes(const PageTableNode *node, int level);
+    static uint64_t subtree_pages(const PageTableNode *node, int level);
+    static void save_node(CheckpointWriter &out, const PageTableNode *node, int level);
+    size_t load_node(CheckpointReader &in, PageTableNode *node, int level, uint64_t frames); // tables created
+
+public:
+    uint64_t walks;       // walks performed by lookup()
+    uint64_t walk_levels; // tables visited by those walks
+
+    PageTable();
+
+    // hardware style walk used by translate, allocates missing tables on the way,
+    // stops early at a huge page; level is the level of the returned leaf (1 = base page)
+    PageTableEntry &lookup(uint64_t vpn, int &level);
+    // same walk for the OS itself (readahead, fork, ...), not counted as a hardware walk
+    PageTableEntry &entry(uint64_t vpn, int &level);
+    PageTableEntry &entry(uint64_t vpn) { int level; return entry(vpn, level); }
+    // software walk (victim / bookkeeping), never allocates, nullptr if not mapped
+    PageTableEntry *find(uint64_t vpn, int &level) const;
+    PageTableEntry *find(uint64_t vpn) const { int level; return find(vpn, level); }
+
+    // leaf of a huge page at level, the tables below it are freed (they must map nothing)
+    PageTableEntry &huge_entry(uint64_t vpn, int level);
+    // base pages mapped inside the aligned range covered by one entry of level
+    uint64_t mapped_pages(uint64_t vpn, int level) const;
+
+    size_t nodes() const { return num_nodes; }
+    size_t memory_bytes() const { return num_nodes * PT_ENTRIES * PT_ENTRY_BYTES; } // simulated overhead
+    size_t host_bytes() const { return num_nodes * sizeof(PageTableNode); } // what the simulator pays
+
+    // the allocated tables and every entry that is not blank, depth first; restore replaces
+    // the whole tree, frames bounds the frame numbers (std::runtime_error)
+    void checkpoint(CheckpointWriter &out) const;
+    void restore(CheckpointReader &in, uint64_t frames);
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <map>
+#include <string>
+#include <ostream>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+class CheckpointWriter;
+class CheckpointReader;
+
+// distribution of non-negative values in power of two buckets:
+// bucket 0 holds 0, bucket i holds [2^(i-1), 2^i - 1]
+class Histogram {
+public:
+    static const int BUCKETS = 65;
+
+private:
+    uint64_t counts[BUCKETS];
+    uint64_t total;
+    uint64_t sum_;
+    uint64_t min_;
+    uint64_t max_;
+
+public:
+    Histogram() { clear(); }
+
+    void record(uint64_t value)
+    {
+        int b = value == 0 ? 0 : 64 - __builtin_clzll(value);
+        counts[b]++;
+        total++;
+        sum_ += value;
+        if (value < min_)
+            min_ = value;
+        if (value > max_)
+            max_ = value;
+    }
+    void clear();
+
+    uint64_t count() const { return total; }
+    uint64_t sum() const { return sum_; }
+    uint64_t min() const { return total ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const { return total ? (double)sum_ / total : 0.0; }
+    uint64_t bucket(int b) const { return counts[b]; }
+    static uint64_t bucket_limit(int b) { return b == 0 ? 0 : b == 64 ? UINT64_MAX : (1ULL << b) - 1; } // largest value in b
+    uint64_t percentile(double p) const; // upper bound of the bucket holding the p-quantile, capped at max
+
+    void checkpoint(CheckpointWriter &out) const;
+    void restore(CheckpointReader &in);
+};
+
+// Named view of the statistics of live modules. Modules add their counters with
+// register_stats(), the registry only points at them, so it is built when needed
+// and must not outlive what it points at.
+class StatsRegistry {
+private:
+    std::map<std::string, const uint64_t *> counters;
+    std::map<std::string, std::function<double()>> gauges;
+    std::map<std::string, const Histogram *> histograms;
+    std::map<std::string, std::function<Histogram()>> distributions; // built at export (free block sizes, ...)
+    uint64_t snapshots; // exports so far
+
+public:
+    StatsRegistry() : snapshots(0) {}
+
+    void counter(const std::string &name, const uint64_t *value);
+    void gauge(const std::string &name, std::function<double()> read);
+    void histogram(const std::string &name, const Histogram *h);
+    void distribution(const std::string &name, std::function<Histogram()> build);
+
+    // one JSON object on one line, so periodic snapshots form a JSON Lines file
+    void write_json(std::ostream &out);
+    // snapshot,metric,kind,value rows, header only before the first snapshot
+    void write_csv(std::ostream &out);
+};
+
+// where a replay sends its statistics
+struct StatsOutput {
+    std::ostream *out;
+    bool json; // else csv
+    uint64_t every; // references between snapshots, 0 = only the final one
+};
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include "batch.h"
+
+// one swept parameter: a batch config key and the values it takes
+//     key=v1,v2,...   each item a value or a range
+//     a..b            a, 2a, 4a, ... up to b (sizes)
+//     a..b*f          a, a*f, a*f*f, ... up to b
+//     a..b+s          a, a+s, a+2s, ... up to b
+struct SweepAxis {
+    std::string key;
+    std::vector<std::string> values;
+};
+
+SweepAxis parse_axis(const std::string &spec); // throws std::invalid_argument
+
+// every combination of the axis values applied to base, last axis varying fastest;
+// throws std::invalid_argument for a value set_option rejects
+struct SweepPoint {
+    std::vector<std::string> values; // one per axis
+    BatchConfig cfg;
+};
+
+std::vector<SweepPoint> expand_grid(const BatchConfig &base, const std::vector<SweepAxis> &axes);
+
+struct SweepRun {
+    BatchResult result;
+    std::string error; // empty if the run completed
+};
+
+// Runs every point on a pool of threads. Each point gets its own simulator and its
+// own reader over the one read-only mapped trace (or its own generator when trace is
+// null). A point that fails records its error, the others go on. Results are in grid order.
+std::vector<SweepRun> run_sweep(const std::vector<SweepPoint> &grid, const char *trace, size_t trace_size,
+                                const std::string &format, size_t threads);
+
+// header + one row per point: the axis values, then the counters
+void write_csv(std::ostream &out, const std::vector<SweepAxis> &axes, const std::vector<SweepPoint> &grid,
+               const std::vector<SweepRun> &runs);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef TLB_H
+#define TLB_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "cache.h" // ReplacementPolicy
+
+struct TlbConfig {
+    size_t sets;
+    size_t ways;
+    ReplacementPolicy policy;
+    uint64_t hit_latency;  // cycles charged when the lookup hits
+    uint64_t miss_latency; // cycles charged when it misses (before going to the next level)
+};
+
+struct TlbEntry {
+    bool valid;
+    int asid;       // process the translation belongs to (0 when ASIDs are not used)
+    uint64_t vpn;   // page number in units of the entry's page size
+    int level;      // 1 = base page, 2 / 3 = huge page (see page_table.h)
+    int frame;      // first frame of the page
+    uint64_t arrival;   // FIFO
+    uint64_t last_used; // LRU
+    uint64_t frequency; // LFU
+};
+
+// set associative translation cache, one instance per TLB level
+class TLB {
+private:
+    size_t num_sets;
+    size_t associativity;
+    ReplacementPolicy policy;
+    uint64_t hit_latency;
+    uint64_t miss_latency;
+    uint64_t global_time;
+    bool has_huge; // a huge page was ever inserted, lookups then probe every page size
+
+    std::vector<std::vector<TlbEntry>> sets; // (number of sets) X (associativity)
+
+    int find_victim(size_t set_index);
+    TlbEntry *probe(int asid, uint64_t vpn, int level);
+
+public:
+    uint64_t hits;
+    uint64_t misses;
+
+    TLB(const TlbConfig &config);
+
+    bool lookup(int asid, uint64_t vpn, int &frame); // counts a hit or a miss, frame of this vpn
+    void insert(int asid, uint64_t vpn, int frame, int level = 1); // frame = first frame of the page
+    void invalidate(int asid, uint64_t vpn, int level = 1); // shootdown of one translation
+    void flush();
+
+    // entries and counters; restore needs the same sets and ways, throws std::runtime_error
+    void checkpoint(CheckpointWriter &out) const;
+    void restore(CheckpointReader &in);
+
+    size_t entries() const { return num_sets * associativity; }
+    uint64_t hit_cost() const { return hit_latency; }
+    uint64_t miss_cost() const { return miss_latency; }
+};
+
+#endif
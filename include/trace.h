@@ -0,0 +1,96 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+enum class TraceOp : uint8_t {
+    READ,
+    WRITE,
+    FETCH, // instruction fetch, a read for the caches
+    ALLOC, // allocator request: addr = allocation id, size = bytes
+    FREE   // addr = id of the allocation to release
+};
+
+// one entry of a trace
+struct TraceRecord {
+    TraceOp op;
+    int pid; // 0 for traces without pids
+    uint64_t addr; // physical address (cache traces) or virtual address (VM traces)
+    uint32_t size; // bytes accessed or allocated, 0 = unknown
+
+    bool is_access() const { return op == TraceOp::READ || op == TraceOp::WRITE || op == TraceOp::FETCH; }
+};
+
+// a trace that can be read front to back, any number of times
+class TraceSource {
+public:
+    virtual ~TraceSource() {}
+    virtual bool next(TraceRecord &r) = 0; // false at the end, throws std::runtime_error on bad input
+    virtual void rewind() = 0;
+};
+
+// read-only view of a whole file, mmap'd where possible (read into memory otherwise)
+class MappedFile {
+private:
+    const char *bytes;
+    size_t length;
+    void *mapping; // null when the file was read instead
+    std::string contents;
+
+public:
+    MappedFile(const std::string &path); // throws std::runtime_error
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const { return bytes; }
+    size_t size() const { return length; }
+};
+
+// Text trace, one reference per line, parsed in place (no copies, no iostreams):
+//     [access] [<pid>] <address> [r|w]
+//     alloc <id> <bytes>
+//     free <id>
+// numbers are decimal or 0x hex, '#' starts a comment. The pid is there only when
+// with_pid is set, so "access <pid> <va> w" lines of a VM script are valid records.
+class TextTrace : public TraceSource {
+private:
+    const char *begin;
+    const char *cur;
+    const char *end;
+    bool with_pid;
+    size_t line; // of the last record returned
+
+    void parse_allocator(const char *p, const char *stop, TraceRecord &r) const;
+
+public:
+    TextTrace(const char *data, size_t size, bool with_pid);
+
+    bool next(TraceRecord &r) override;
+    void rewind() override { cur = begin; line = 0; }
+    size_t line_number() const { return line; }
+};
+
+// output of valgrind --tool=lackey --trace-mem=yes:
+//     I  04000c50,3     instruction fetch
+//      L 7ff000398,8    load (S = store, M = modify: a load and a store)
+// other lines (==pid== messages) are skipped
+class LackeyTrace : public TraceSource {
+private:
+    const char *begin;
+    const char *cur;
+    const char *end;
+    bool pending_store; // second half of an M line
+
+    TraceRecord last;
+
+public:
+    LackeyTrace(const char *data, size_t size);
+
+    bool next(TraceRecord &r) override;
+    void rewind() override { cur = begin; pending_store = false; }
+};
+
+#endif
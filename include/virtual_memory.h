@@ -2,26 +2,159 @@
 #define VIRTUAL_MEMORY_H
 
 #include <vector>
-#include <map>
+#include <memory>
+#include <string>
+#include <set>
+#include <unordered_map>
 #include <cstdint>
+#include <cstddef>
+#include "page_table.h"
+#include "tlb.h"
+#include "backing_store.h"
+#include "buddy.h"
+#include "numa.h"
+#include "stats.h"
 
 enum class PageReplacement {
     FIFO,
     LRU,
-    CLOCK
+    CLOCK,
+    AGING,   // NFU with 8 bit shift registers
+    WSCLOCK, // working set clock with window tau
+    OPT      // Belady, needs the future reference string (set_future)
 };
 
-struct PageTableEntry {
-    bool valid;
-    int frame;
-    uint64_t arrival;
-    uint64_t last_used;
-    bool ref_bit;
+const uint64_t OPT_NEVER = UINT64_MAX;     // page is not referenced again
+const uint64_t OPT_UNSET = UINT64_MAX - 1; // frame not tracked by OPT
+
+// faults Belady's OPT takes on a reference string with the given frames (lower bound)
+uint64_t opt_page_faults(const std::vector<SwapKey> &refs, size_t frames);
+
+// where a victim may come from when a process needs a frame
+enum class ReplacementScope {
+    GLOBAL, // any process (a streaming process can push the others out)
+    LOCAL   // the faulting process itself once memory is full
+};
+
+// how allocate_frames() splits the frames into per-process quotas
+enum class FrameAllocation {
+    NONE,         // no quotas
+    EQUAL,        // frames / processes each
+    PROPORTIONAL, // by virtual size
+    PRIORITY      // by priority weight
+};
+
+// swap device cost model: every transfer pays the access latency plus the page at the device bandwidth
+struct SwapDevice {
+    uint64_t latency;      // cycles per request
+    double bytes_per_cycle; // bandwidth
 };
 
 struct FrameInfo {
     int pid; // process id
-    int vpn; // virtual page number
+    uint64_t vpn; // virtual page number
+    int level; // page size of the mapping (1 = base page, see page_table.h)
+    int head; // first frame of the mapping, itself for base pages
+};
+
+// doubly linked list threaded through frame numbers, O(1) push / remove / move
+struct FrameList {
+    std::vector<int> prev;
+    std::vector<int> next;
+    int head; // oldest / least recently used frame, -1 when empty
+    int tail;
+    size_t count;
+
+    void init(size_t frames);
+    bool contains(int frame) const { return prev[frame] != -2; }
+    int after(int frame) const { return next[frame]; }
+    void push_back(int frame);
+    void push_front(int frame);
+    void remove(int frame);
+    void move_to_back(int frame) { remove(frame); push_back(frame); }
+    void replace(int frame, int with); // with takes frame's place in the order
+};
+
+// a process' frames, same operations as FrameList; the links are hashed by frame so a
+// process only costs memory for the frames it holds (a shared frame is on several of these)
+struct ProcessFrames {
+    struct Link {
+        int prev;
+        int next;
+    };
+    std::unordered_map<int, Link> links;
+    int head = -1;
+    int tail = -1;
+    size_t count = 0;
+
+    bool contains(int frame) const { return links.count(frame) != 0; }
+    int after(int frame) const { return links.at(frame).next; }
+    void push_back(int frame);
+    void remove(int frame);
+    void move_to_back(int frame) { remove(frame); push_back(frame); }
+    void replace(int frame, int with);
+};
+
+// virtual range that is backed by huge pages (explicit mapping)
+struct HugeRegion {
+    uint64_t first_vpn;
+    uint64_t end_vpn; // exclusive
+    int level;
+};
+
+// virtual range mapping a shared segment (shared library, ...), copy on write
+struct SharedRegion {
+    uint64_t first_vpn;
+    uint64_t end_vpn; // exclusive
+    int segment; // page i of the range is page i of the segment
+};
+
+// swap key of a segment page; segments use negative pids so they never clash with a process
+inline SwapKey segment_key(int segment, uint64_t page) { return {-2 - segment, page}; }
+
+struct Process {
+    uint64_t num_pages; // size of the virtual address space in pages
+    PageTable page_table; // radix page table, tables allocated on touch
+    uint64_t readahead_next; // readahead: page a sequential stream faults on next
+    std::vector<HugeRegion> huge_regions;
+    std::vector<SharedRegion> shared_regions;
+
+    ProcessFrames frames; // this process' part of resident, same order
+    uint64_t resident_pages; // RSS in frames (a huge page counts all of its frames)
+    uint64_t quota; // max resident frames, 0 = unlimited
+    unsigned priority; // weight for FrameAllocation::PRIORITY
+    uint64_t faults;
+    uint64_t hits;
+    uint64_t cow_faults;
+
+    int home_node; // NUMA node the process runs on
+    NumaPolicy numa_policy;
+    int preferred_node; // NumaPolicy::PREFERRED
+    int interleave_next; // NumaPolicy::INTERLEAVE: node of the next page
+    uint64_t local_refs; // NUMA: references to memory on the home node
+    uint64_t remote_refs; // and to memory on other nodes
+};
+
+// processes are looked up in a flat vector indexed by pid, so pids are bounded
+const int VM_MAX_PID = 65535;
+
+// owner of frames held by a DMA-style allocation (not a mapping, never evicted)
+const int DMA_OWNER = INT32_MIN;
+
+// contiguous (multi-frame) allocations of one buddy order
+struct OrderStats {
+    uint64_t requests;
+    uint64_t from_free; // a free aligned run was there
+    uint64_t reclaimed; // a run had to be cleared by evicting pages first
+    uint64_t failures; // every candidate run held pinned or DMA frames
+    uint64_t first_failure; // reference count (time) of the first failure, 0 = none
+};
+
+// readahead state of a frame
+enum class Prefetch : uint8_t {
+    NONE,      // demand paged, or a prefetched page that has been used
+    ZERO_FILL, // prefetched, never was on swap
+    SWAPPED    // prefetched with a read from swap
 };
 
 class VirtualMemory {
@@ -31,29 +164,228 @@ private:
     uint64_t time; // time for fifo
     PageReplacement policy; // replacement policy
 
-    std::map<int, std::vector<PageTableEntry>> page_tables; // page table
-    std::vector<FrameInfo> frame_table; // frame table contains the data of frame
+    std::vector<std::unique_ptr<Process>> processes; // indexed by pid, null if pid unused
+    std::vector<FrameInfo> frame_table; // frame table contains the data of frame (owner of a segment page: its segment_key)
+    std::vector<uint32_t> frame_refs; // page table entries mapping the frame
+    std::unordered_map<int, std::vector<SwapKey>> sharers; // reverse map of shared and segment frames
+    std::unordered_map<SwapKey, int, SwapKeyHash> segment_frames; // resident segment pages
+    uint64_t cow_copy_cycles; // cost of breaking sharing with a copy
+    FrameList free_list; // unused frames, used as a stack (head = next frame handed out); unused with buddy
+    std::unique_ptr<BuddyAllocator> buddy; // frame allocator in buddy mode (addresses = frame numbers)
+    std::unordered_map<int, uint64_t> dma_blocks; // first frame -> frames of live DMA allocations
+    std::vector<OrderStats> order_stats; // indexed by order
+    std::vector<uint32_t> free_in_block; // free frames per aligned 2 MiB-class block
+    std::unique_ptr<NumaTopology> numa; // null = one node
+    std::vector<FrameList> node_free; // NUMA: free frames of each node, kept next to free_list
+    std::vector<std::vector<int>> node_fallback; // NUMA: nodes to try, nearest first, per wanted node
+    std::vector<uint32_t> remote_streak; // NUMA: remote references in a row per frame
+    uint64_t migrate_threshold; // remote references in a row before a page moves, 0 = never
+    uint64_t migrate_cycles; // cost of moving a page
+    std::vector<uint8_t> pinned; // frames that must not be evicted right now
+    FrameList resident; // first frame of every mapping in arrival (FIFO) or recency (LRU) order
 
-    std::vector<std::vector<uint8_t>> disk; // disk just for simulation
-    std::vector<std::vector<uint8_t>> physical_memory; // physical memory 
+    BackingStore swap; // disk, one slot per (pid, vpn) created on first page out
+    SwapDevice swap_device;
+    std::vector<std::vector<uint8_t>> physical_memory; // physical memory, a frame is allocated on its first page in
 
-    size_t clock_hand; // clock hand shows which page to evict according to clock page replacement policy 
+    size_t clock_hand; // clock hand shows which page to evict according to clock page replacement policy
 
-    int find_victim_frame();
-    void page_out(int pid, int vpn, int frame);
-    void page_in(int pid, int vpn, int frame);
+    std::unique_ptr<TLB> l1_tlb; // dTLB, null when TLB simulation is off
+    std::unique_ptr<TLB> l2_tlb; // STLB behind it
+    bool tlb_asid; // entries tagged with pid, otherwise flushed on every process switch
+    uint64_t walk_latency; // cycles per page-table level visited on a TLB miss
+    int last_pid; // process of the previous translate
+
+    std::vector<uint8_t> age; // AGING shift register per frame
+    uint64_t aging_interval; // references between two aging ticks
+    uint64_t ws_tau; // WSCLOCK working set window, in references
+
+    std::vector<uint64_t> future_next_use; // OPT: next use of each position of the future trace
+    uint64_t opt_position; // OPT: position of the current reference in that trace
+    uint64_t current_next_use; // OPT: next use of the page referenced now
+    std::vector<uint64_t> resident_next_use; // OPT: per frame
+    std::set<std::pair<uint64_t, int>> opt_order; // OPT: (next use, frame)
+
+    ReplacementScope scope;
+
+    int find_victim_frame(int pid = -1); // only frames of pid if not -1, -1 if every candidate is pinned
+    void touch_frame(int pid, int frame); // a reference by pid to a resident page
+    void referenced(int pid, PageTableEntry &pte, int frame, bool write); // page hit through pte
+    void aging_tick();
+    void set_next_use(int frame, uint64_t next);
+
+    size_t readahead_min; // readahead window bounds in pages, max 0 = off
+    size_t readahead_max;
+    size_t readahead_window; // current adaptive window
+    std::vector<Prefetch> prefetched; // per frame
+
+    void readahead(int pid, Process &proc, uint64_t vpn, int demand_frame);
+
+    bool is_shared(int frame) const { return frame_refs[frame] > 1 || frame_table[frame].pid < -1; }
+    void unmap_shared(int frame); // evict a shared frame from every process mapping it
+    void unshare(int frame, int pid, uint64_t vpn); // drop one mapping of a shared frame
+    int cow_fault(int pid, Process &proc, uint64_t vpn, PageTableEntry &pte); // frame now private to pid
+    const SharedRegion *shared_region(const Process &proc, uint64_t vpn) const;
+    int map_segment_page(int pid, Process &proc, uint64_t vpn, PageTableEntry &pte, const SharedRegion &region);
+
+    bool thp; // transparent promotion of fully populated 2 MiB-class ranges
+
+    int huge_level(const Process &proc, uint64_t vpn) const; // page size wanted at vpn
+    int map_huge_page(int pid, Process &proc, uint64_t vpn, int level, bool write); // -1 if not possible
+    int promote(int pid, Process &proc, uint64_t vpn); // collapse the 2 MiB-class range of vpn, first frame or -1
+
+    void claim_frame(int frame); // bookkeeping for a frame leaving the free pool
+    void release_frame(int frame); // and for one coming back (on top of the free stack)
+    bool has_free_frame() const { return buddy ? buddy->largest_free_block() > 0 : free_list.head != -1; }
+    // free frame for pid, evicting a victim if there is none (or pid is at its quota),
+    // -1 if that would be keep or nothing is evictable
+    int allocate_frame(int pid, int keep = -1);
+    bool fit_quota(int pid, int keep = -1); // evicts pid's own pages until one more fits its quota
+    int allocate_run(uint64_t frames); // aligned run of a power of two frames, -1 if impossible
+    uint64_t used_frames(uint64_t first, uint64_t frames) const; // frames of the run not free
+    int numa_frame(Process &proc); // free frame picked by the placement policy (one must exist)
+    int numa_reference(int pid, Process &proc, uint64_t vpn, int frame); // frame holding vpn afterwards
+    uint64_t translate_page(int pid, uint64_t virtual_address, bool write); // translate() without NUMA
+    void evict_frame(int frame); // page out and unmap the mapping starting at frame, frames go back to the free list
+    void map_frame(int pid, uint64_t vpn, PageTableEntry &pte, int frame, bool prefetch = false, int level = 1);
+    void install(int pid, uint64_t vpn, PageTableEntry &pte, int frame, int level); // map_frame without the page in
+    int tlb_asid_of(int pid) const { return tlb_asid ? pid : 0; }
+    void tlb_fill(int pid, uint64_t vpn, int frame, int level);
+    void tlb_shootdown(int pid, uint64_t vpn, int level);
+    PageTableEntry &frame_pte(int frame); // pte currently mapping a used frame
+    void page_out(int pid, uint64_t vpn, int frame, uint64_t pages); // write back, charged to fault_cycles
+    // charged only if a page was on swap, readahead pages share one request latency
+    bool page_in(int pid, uint64_t vpn, int frame, uint64_t pages, bool batched = false);
+    uint64_t transfer_cycles(uint64_t pages) const;
 
 public:
     size_t page_hits;
     size_t page_faults;
 
+    uint64_t translation_cycles; // TLB lookups + page walks charged so far
+    uint64_t page_walks; // walks caused by STLB misses
+    uint64_t walk_cycles;
+    uint64_t tlb_flushes; // full flushes on process switch (no ASIDs)
+
+    uint64_t fault_cycles; // swap I/O charged while servicing faults
+    uint64_t major_faults; // faults that read the page back from swap
+    uint64_t writebacks; // dirty pages written to swap
+    uint64_t clean_evictions; // evictions that skipped the write back
+
+    uint64_t readahead_pages; // pages brought in ahead of use
+    uint64_t readahead_hits; // of those, referenced before eviction (= faults avoided)
+    uint64_t readahead_wasted; // evicted without being referenced
+    int64_t readahead_saved_cycles; // fault cycles avoided minus extra transfer paid
+
+    uint64_t huge_faults; // faults served with a huge page
+    uint64_t huge_fallbacks; // huge page wanted but served with a base page
+    uint64_t thp_promotions; // populated ranges collapsed into a huge page
+    uint64_t thp_failures; // promotions without a free aligned run
+
+    uint64_t cow_faults; // writes to a copy-on-write page
+    uint64_t cow_copies; // of those, the ones that had to copy (others were the last sharer)
+    uint64_t shared_faults; // faults served by a frame another process already had resident
+
+    uint64_t numa_fallbacks; // pages placed off the node the policy asked for (it was full)
+    uint64_t numa_migrations; // pages moved to the node of the process using them
+    uint64_t numa_migration_failures; // moves skipped because that node was full
+
+    Histogram translate_latency; // cycles per translate() (TLB, walk and fault service)
+    Histogram fault_latency; // swap I/O cycles per translate() that paid any
+
     VirtualMemory(size_t num_pages,
                   size_t num_frames,
                   size_t page_size,
                   PageReplacement policy);
 
-    void create_process(int pid, size_t num_pages);
-    uint64_t translate(int pid, uint64_t virtual_address);
+    void create_process(int pid, uint64_t num_pages);
+    // throws std::out_of_range on bad pid / address, a write marks the page dirty
+    uint64_t translate(int pid, uint64_t virtual_address, bool write = false);
+    uint64_t cycles() const { return translation_cycles + fault_cycles; } // everything translate() charged
+    void register_stats(StatsRegistry &stats, const std::string &prefix) const;
+
+    // replacement policy parameters
+    void set_aging_interval(uint64_t refs);
+    void set_ws_tau(uint64_t refs) { ws_tau = refs; }
+    // OPT: the complete reference string that translate() is about to see
+    void set_future(const std::vector<SwapKey> &refs);
+    PageReplacement replacement() const { return policy; }
+    void set_swap_device(const SwapDevice &device) { swap_device = device; }
+    // adaptive fault-around: up to max pages after a faulting page, max 0 disables it
+    void set_readahead(size_t min_pages, size_t max_pages);
+    size_t readahead_size() const { return readahead_max == 0 ? 0 : readahead_window; }
+
+    // physical frame allocator: frames come from a BuddyAllocator instead of the free stack,
+    // only before the first frame is handed out; throws std::runtime_error
+    void use_buddy();
+    bool buddy_enabled() const { return buddy != nullptr; }
+    const BuddyAllocator *frame_allocator() const { return buddy.get(); }
+    const std::vector<OrderStats> &allocation_orders() const { return order_stats; }
+    // DMA-style request: physically contiguous, pinned frames (rounded up to a power of two),
+    // first frame or -1 if no run can be freed; needs the buddy allocator (std::runtime_error)
+    int dma_alloc(uint64_t frames);
+    void dma_free(int first); // throws std::invalid_argument
+
+    // NUMA: frames split evenly over nodes with a local and a remote latency, processes run on
+    // node pid % nodes; only before the first frame is handed out, throws std::runtime_error
+    void use_numa(size_t nodes, uint64_t local_latency, uint64_t remote_latency);
+    const NumaTopology *numa_topology() const { return numa.get(); }
+    void set_numa_latency(int cpu_node, int memory_node, uint64_t cycles); // throws std::out_of_range
+    void set_home_node(int pid, int node); // throws std::out_of_range
+    void set_numa_policy(int pid, NumaPolicy policy, int node = 0); // node for PREFERRED
+    // move a private base page to its process' node after refs remote references in a row, 0 = off
+    void set_numa_migration(uint64_t refs, uint64_t cycles_per_page);
+    uint64_t numa_migration_refs() const { return migrate_threshold; }
+    uint64_t memory_latency(int pid, uint64_t physical_address) const; // DRAM access cost, NUMA only
+    size_t node_free_frames(int node) const { return node_free[node].count; }
+
+    // huge pages: back [va, va + length) of pid with pages of level (HUGE_2M_LEVEL / HUGE_1G_LEVEL)
+    // on fault; throws std::out_of_range / std::invalid_argument
+    void map_huge(int pid, uint64_t va, uint64_t length, int level);
+    void set_thp(bool on) { thp = on; }
+    bool thp_enabled() const { return thp; }
+    size_t huge_pages_resident(int level) const;
+
+    // copy-on-write fork: child gets the parent's address space, resident pages are shared
+    // until written; throws std::out_of_range / std::invalid_argument
+    void fork(int parent, int child);
+    // map pages of a shared segment at [va, va + length) of pid, shared with every other mapper
+    void map_shared(int pid, uint64_t va, uint64_t length, int segment);
+    void set_cow_cost(uint64_t cycles) { cow_copy_cycles = cycles; }
+    uint64_t frames_saved() const; // extra mappings of shared frames = frames not spent on copies
+
+    // resident set quotas; a process at its quota replaces its own pages whatever the scope
+    void set_scope(ReplacementScope s) { scope = s; }
+    ReplacementScope replacement_scope() const { return scope; }
+    void set_quota(int pid, uint64_t frames); // 0 = unlimited, throws std::out_of_range
+    void set_priority(int pid, unsigned weight); // throws std::out_of_range
+    void allocate_frames(FrameAllocation mode); // quotas for every existing process
+    const Process *process(int pid) const; // nullptr if pid is unused
+
+    // TLB hierarchy, rebuilt empty on every call
+    void configure_tlb(const TlbConfig &l1, const TlbConfig &l2, bool asid, uint64_t walk_latency);
+    void disable_tlb();
+    const TLB *dtlb() const { return l1_tlb.get(); }
+    const TLB *stlb() const { return l2_tlb.get(); }
+
+    // swap into a sparse mmap'd file instead of host memory, throws std::runtime_error
+    void use_swap_file(const std::string &path) { swap.use_file(path); }
+    const BackingStore &backing_store() const { return swap; }
+    size_t resident_bytes() const; // host memory actually used by frames
+    size_t page_bytes() const { return page_size; }
+
+    // page table overhead summed over all processes
+    size_t page_table_nodes() const;
+    size_t page_table_bytes() const;
+    size_t page_table_host_bytes() const;
+    double average_walk_depth() const;
+
+    // processes, page tables, frames with their contents, replacement state, swap, TLBs and
+    // counters, section VMEM. Restore needs a VM with the same geometry and policy that has not
+    // translated yet; OPT, buddy frames, NUMA, DMA and shared pages are not supported.
+    // Both throw std::runtime_error.
+    void checkpoint(CheckpointWriter &out);
+    void restore(CheckpointReader &in);
 };
 
 #endif
@@ -0,0 +1,140 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <vector>
+#include <deque>
+#include <queue>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+#include "trace.h"
+
+// splitmix64: one add and three multiply / xor-shift steps per number, and
+// the stream is fully determined by the seed
+class SplitMix64 {
+private:
+    uint64_t state;
+
+public:
+    SplitMix64(uint64_t seed) : state(seed) {}
+
+    uint64_t next()
+    {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+    uint64_t below(uint64_t n) { return (uint64_t)(((unsigned __int128)next() * n) >> 64); } // 0 .. n - 1
+    double uniform() { return (next() >> 11) * 0x1.0p-53; } // [0, 1)
+};
+
+/* ---------------- ADDRESS STREAMS ---------------- */
+
+enum class AddressPattern {
+    SEQUENTIAL,    // 8 byte words front to back, wrapping at the footprint
+    STRIDED,       // every stride bytes
+    UNIFORM,       // any word of the footprint
+    ZIPF,          // cache lines by Zipf rank: a small hot set takes most references
+    POINTER_CHASE, // one random cycle through all cache lines, every step depends on the last
+    PHASED         // uniform within a hot window that moves every phase_length references
+};
+
+struct AddressWorkload {
+    AddressPattern pattern;
+    uint64_t count; // references
+    uint64_t footprint; // bytes, addresses are 0 .. footprint - 1
+    uint64_t stride; // STRIDED
+    double zipf_theta; // ZIPF skew, 0 < theta < 1
+    uint64_t hot_bytes; // PHASED window
+    uint64_t phase_length; // PHASED
+    double write_ratio;
+    size_t processes; // pids 0 .. processes - 1, interleaved
+    uint64_t seed;
+};
+
+AddressWorkload default_address_workload();
+
+// generated references, no text in between: a TraceSource for the batch replay
+class AddressGenerator : public TraceSource {
+private:
+    AddressWorkload w;
+    SplitMix64 rng;
+    uint64_t produced;
+    uint64_t offset; // SEQUENTIAL / STRIDED position, POINTER_CHASE line
+    uint64_t lines; // cache lines in the footprint
+    uint64_t write_threshold;
+
+    // ZIPF (Gray et al., "Quickly generating billion-record synthetic databases")
+    double zipf_zetan;
+    double zipf_alpha;
+    double zipf_eta;
+    std::vector<uint64_t> chase; // POINTER_CHASE: line -> next line
+    uint64_t window; // PHASED: first byte of the hot window
+
+    uint64_t zipf_line();
+
+public:
+    AddressGenerator(const AddressWorkload &workload); // throws std::invalid_argument
+
+    bool next(TraceRecord &r) override;
+    void rewind() override; // the same stream again
+};
+
+/* ---------------- ALLOCATION STREAMS ---------------- */
+
+enum class SizeDistribution {
+    FIXED,       // always min_size
+    UNIFORM,     // min_size .. max_size
+    EXPONENTIAL, // min_size plus an exponential tail with the given mean, capped at max_size
+    BIMODAL      // 90% small (min_size .. 2 x min_size), 10% large (max_size / 2 .. max_size)
+};
+
+enum class LifetimeModel {
+    FIFO,       // the oldest allocation is freed first
+    LIFO,       // the newest is freed first (stack-like)
+    RANDOM,     // any live allocation
+    EXPONENTIAL // each allocation lives an exponential number of allocations
+};
+
+struct AllocationWorkload {
+    uint64_t count; // records, allocations and frees
+    SizeDistribution sizes;
+    uint32_t min_size;
+    uint32_t max_size;
+    double mean_size; // EXPONENTIAL
+    LifetimeModel lifetime;
+    size_t live; // FIFO / LIFO / RANDOM: live allocations the stream hovers around
+    double mean_lifetime; // EXPONENTIAL, in allocations
+    uint64_t seed;
+};
+
+AllocationWorkload default_allocation_workload();
+
+// "alloc <id> <bytes>" / "free <id>" records, ids count up from 0
+class AllocationGenerator : public TraceSource {
+private:
+    struct Death {
+        uint64_t when;
+        uint64_t id;
+        bool operator>(const Death &o) const { return when > o.when; }
+    };
+
+    AllocationWorkload w;
+    SplitMix64 rng;
+    uint64_t produced;
+    uint64_t next_id;
+    std::deque<uint64_t> live; // allocation order (FIFO / LIFO / RANDOM)
+    std::priority_queue<Death, std::vector<Death>, std::greater<Death>> deaths; // EXPONENTIAL
+
+    uint32_t next_size();
+    bool free_one(uint64_t &id); // false if nothing should be freed now
+
+public:
+    AllocationGenerator(const AllocationWorkload &workload); // throws std::invalid_argument
+
+    bool next(TraceRecord &r) override;
+    void rewind() override;
+};
+
+#endif
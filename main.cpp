@@ -2,17 +2,170 @@
 #include <cstdint>
 #include <string>
 #include <sstream>
+#include <fstream>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <memory>
 
 // your already-written modules
 #include "include/memory.h"
 #include "include/cache.h"
 #include "include/virtual_memory.h"
+#include "include/concurrent_vm.h"
 #include "include/buddy.h"
+#include "include/dram.h"
+#include "include/batch.h"
+#include "include/stats.h"
 
 using namespace std;
 
-int main()
+// -------- DRAM (cache and VM menus) --------
+// dram on|off|geometry|timing|policy|sched|replay; geometry and timing changes rebuild a running controller
+static void dram_command(stringstream &ss, DramConfig &cfg, unique_ptr<DramController> &dram,
+                         vector<uint64_t> &ram_trace)
 {
+    string what;
+    ss >> what;
+    DramConfig next = cfg;
+    if (what == "off")
+    {
+        dram.reset();
+        ram_trace.clear();
+        cout << "DRAM model off, misses cost a flat latency\n";
+        return;
+    }
+    if (what == "geometry")
+    {
+        if (!(ss >> next.channels >> next.ranks >> next.banks >> next.row_bytes))
+        {
+            cout << "Usage: dram geometry <channels> <ranks> <banks> <row bytes>\n";
+            return;
+        }
+    }
+    else if (what == "timing")
+    {
+        if (!(ss >> next.t_cas >> next.t_rcd >> next.t_rp >> next.t_burst))
+        {
+            cout << "Usage: dram timing <tCAS> <tRCD> <tRP> <burst> (cycles)\n";
+            return;
+        }
+    }
+    else if (what == "policy")
+    {
+        string mode;
+        ss >> mode;
+        if (mode != "open" && mode != "closed")
+        {
+            cout << "Usage: dram policy open|closed\n";
+            return;
+        }
+        next.page_policy = (mode == "open") ? DramPagePolicy::OPEN : DramPagePolicy::CLOSED;
+    }
+    else if (what == "sched")
+    {
+        string mode;
+        ss >> mode;
+        if (mode != "fcfs" && mode != "frfcfs")
+        {
+            cout << "Usage: dram sched fcfs|frfcfs\n";
+            return;
+        }
+        next.scheduler = (mode == "fcfs") ? DramScheduler::FCFS : DramScheduler::FR_FCFS;
+    }
+    else if (what == "replay")
+    {
+        size_t outstanding;
+        if (!(ss >> outstanding) || outstanding == 0)
+        {
+            cout << "Usage: dram replay <outstanding misses>\n";
+            return;
+        }
+        if (ram_trace.empty())
+        {
+            cout << "No RAM accesses recorded (turn on the DRAM model with: dram on)\n";
+            return;
+        }
+        cout << ram_trace.size() << " RAM accesses, " << outstanding << " in flight\n";
+        for (DramScheduler sched : {DramScheduler::FCFS, DramScheduler::FR_FCFS})
+        {
+            DramConfig c = cfg;
+            c.scheduler = sched;
+            DramReplay r = replay_dram(c, ram_trace, outstanding);
+            cout << (sched == DramScheduler::FCFS ? "FCFS   " : "FR-FCFS") << ": " << r.cycles << " cycles"
+                 << " Average latency " << r.average_latency
+                 << " Row hit rate " << r.row_hit_rate * 100 << "%"
+                 << " Bandwidth " << r.bandwidth << " bytes/cycle\n";
+        }
+        return;
+    }
+    else if (what != "on")
+    {
+        cout << "Usage: dram on|off|geometry|timing|policy|sched|replay ...\n";
+        return;
+    }
+
+    try
+    {
+        dram.reset(new DramController(next));
+        cfg = next;
+        cout << "DRAM: " << cfg.channels << " channel(s) x " << cfg.ranks << " rank(s) x " << cfg.banks
+             << " banks, " << cfg.row_bytes << " byte rows, "
+             << (cfg.page_policy == DramPagePolicy::OPEN ? "open" : "closed") << " page, "
+             << (cfg.scheduler == DramScheduler::FCFS ? "FCFS" : "FR-FCFS") << "\n";
+    }
+    catch (const exception &e)
+    {
+        cout << e.what() << "\n";
+    }
+}
+
+static void print_dram_stats(const DramController &dram)
+{
+    cout << "\n--- DRAM STATS ---\n";
+    cout << "Requests: " << dram.requests << " Row hits: " << dram.row_hits
+         << " Row misses: " << dram.row_misses << " Row conflicts: " << dram.row_conflicts << "\n";
+    cout << "Row-buffer hit rate: " << dram.row_hit_rate() * 100 << "%\n";
+    cout << "Average latency: " << dram.average_latency() << " cycles"
+         << " Bandwidth: " << dram.bandwidth() << " bytes/cycle\n";
+}
+
+// -------- STATS EXPORT (every menu) --------
+// export json|csv [file]: one snapshot of the registry on cout or in a file
+static void export_stats(stringstream &ss, StatsRegistry &registry)
+{
+    string format, file;
+    ss >> format >> file;
+    if (format != "json" && format != "csv")
+    {
+        cout << "Usage: export json|csv [file]\n";
+        return;
+    }
+    ofstream fout;
+    if (!file.empty())
+    {
+        fout.open(file);
+        if (!fout)
+        {
+            cout << "Cannot open " << file << "\n";
+            return;
+        }
+    }
+    ostream &out = file.empty() ? cout : fout;
+    if (format == "json")
+        registry.write_json(out);
+    else
+        registry.write_csv(out);
+    if (!file.empty())
+        cout << "Written to " << file << "\n";
+}
+
+int main(int argc, char **argv)
+{
+    // command line arguments: non-interactive trace replay
+    if (argc > 1)
+        return run_batch(argc, argv);
+
     cout << "========================================\n";
     cout << " Welcome to the Memory Simulator\n";
     cout << "========================================\n";
@@ -99,6 +252,17 @@ int main()
                 {
                     mem->dump(); // stats already printed inside dump
                 }
+                else if (cmd == "export")
+                {
+                    if (!mem)
+                    {
+                        cout << "Memory not initialized\n";
+                        continue;
+                    }
+                    StatsRegistry registry;
+                    mem->register_stats(registry, "memory");
+                    export_stats(ss, registry);
+                }
                 else if (cmd == "exit")
                 {
                     delete mem;
@@ -111,6 +275,7 @@ int main()
                     cout << "malloc <size>           : Allocate memory (e.g., malloc 200)\n";
                     cout << "free <id>               : Free allocated block by ID\n";
                     cout << "dump                    : Show memory status\n";
+                    cout << "export json|csv [file]  : Export counters and histograms\n";
                     cout << "help                    : Show this help menu\n";
                     cout << "exit                    : Exit simulator\n\n";
 
@@ -132,6 +297,10 @@ int main()
 
             const uint64_t RAM_LATENCY = 100;
             uint64_t total_cycles = 0;
+            DramConfig dram_cfg = default_dram_config();
+            unique_ptr<DramController> dram; // null = flat RAM_LATENCY
+            vector<uint64_t> ram_trace; // addresses that went to DRAM, for dram replay
+            Histogram access_latency; // cycles per access
 
             cin.ignore();
             while (true)
@@ -177,15 +346,16 @@ int main()
                     cout << "Latency: ";
                     cin >> l3_lat;
 
-                    cout << "Replacement Policy (fifo / lru / lfu): ";
+                    cout << "Replacement Policy (fifo / lru / lfu / adaptive): ";
                     string pol;
                     cin >> pol;
-                    if (pol != "fifo" && pol != "lru" && pol != "lfu")
+                    if (pol != "fifo" && pol != "lru" && pol != "lfu" && pol != "adaptive")
                     {
                         cout << "Invalid policy , Policy set to LFU" << "\n";
                     }
                     ReplacementPolicy rp =
                         (pol == "fifo") ? ReplacementPolicy::FIFO : (pol == "lru") ? ReplacementPolicy::LRU
+                        : (pol == "adaptive")                                      ? ReplacementPolicy::ADAPTIVE
                                                                                    : ReplacementPolicy::LFU;
 
                     delete L1;
@@ -197,6 +367,10 @@ int main()
                     L3 = new Cache(c3, bsize, a3, rp, l3_lat);
 
                     total_cycles = 0;
+                    dram_cfg.line_bytes = bsize;
+                    if (dram)
+                        dram.reset(new DramController(dram_cfg));
+                    ram_trace.clear();
                     cout << "Caches initialized successfully\n";
 
                     cin.ignore();
@@ -213,6 +387,7 @@ int main()
 
                     uint64_t addr;
                     ss >> addr;
+                    uint64_t start_cycles = total_cycles;
 
                     if (L1->access(addr))
                     {
@@ -234,13 +409,22 @@ int main()
                     }
                     else
                     {
-                        total_cycles += L1->latency() + L2->latency() +
-                                        L3->latency() + RAM_LATENCY;
+                        total_cycles += L1->latency() + L2->latency() + L3->latency();
+                        if (dram)
+                        {
+                            total_cycles += dram->access(addr, total_cycles);
+                            ram_trace.push_back(addr);
+                        }
+                        else
+                        {
+                            total_cycles += RAM_LATENCY;
+                        }
                         L3->access(addr);
                         L2->access(addr);
                         L1->access(addr);
                         cout << "MISS -> RAM ACCESS\n";
                     }
+                    access_latency.record(total_cycles - start_cycles);
                 }
 
                 // -------- STATS --------
@@ -253,10 +437,115 @@ int main()
                     }
 
                     cout << "\n--- CACHE STATS ---\n";
-                    cout << "L1 Hits: " << L1->hits << " Misses: " << L1->misses << "\n";
-                    cout << "L2 Hits: " << L2->hits << " Misses: " << L2->misses << "\n";
-                    cout << "L3 Hits: " << L3->hits << " Misses: " << L3->misses << "\n";
+                    Cache *levels[3] = {L1, L2, L3};
+                    for (int i = 0; i < 3; i++)
+                    {
+                        cout << "L" << i + 1 << " Hits: " << levels[i]->hits << " Misses: " << levels[i]->misses;
+                        if (levels[i]->victim_entries())
+                            cout << " Victim cache hits: " << levels[i]->victim_hits;
+                        if (levels[i]->replacement() == ReplacementPolicy::ADAPTIVE)
+                            cout << " (followers use " << (levels[i]->lfu_winning() ? "LFU" : "LRU") << ")";
+                        cout << "\n";
+                    }
                     cout << "Total cycles: " << total_cycles << "\n";
+                    if (dram)
+                        print_dram_stats(*dram);
+                }
+                else if (cmd == "dram")
+                {
+                    if (!L1)
+                    {
+                        cout << "Cache not initialized\n";
+                        continue;
+                    }
+                    dram_command(ss, dram_cfg, dram, ram_trace);
+                }
+                else if (cmd == "export")
+                {
+                    if (!L1)
+                    {
+                        cout << "Cache not initialized\n";
+                        continue;
+                    }
+                    StatsRegistry registry;
+                    registry.counter("total_cycles", &total_cycles);
+                    registry.histogram("access.latency", &access_latency);
+                    L1->register_stats(registry, "l1");
+                    L2->register_stats(registry, "l2");
+                    L3->register_stats(registry, "l3");
+                    if (dram)
+                        dram->register_stats(registry, "dram");
+                    export_stats(ss, registry);
+                }
+
+                // -------- INSTRUMENTATION --------
+                else if (cmd == "heatmap" || cmd == "regions")
+                {
+                    if (!L1)
+                    {
+                        cout << "Cache not initialized\n";
+                        continue;
+                    }
+                    if (!Cache::instrumented())
+                    {
+                        cout << "Instrumentation disabled, rebuild with: make clean && make INSTRUMENT=1\n";
+                        continue;
+                    }
+
+                    string file;
+                    ss >> file;
+                    ofstream fout;
+                    if (!file.empty())
+                    {
+                        fout.open(file);
+                        if (!fout)
+                        {
+                            cout << "Cannot open " << file << "\n";
+                            continue;
+                        }
+                    }
+                    ostream &out = file.empty() ? cout : fout;
+
+                    if (cmd == "heatmap")
+                    {
+                        L1->dump_set_stats(out, "L1", true);
+                        L2->dump_set_stats(out, "L2", false);
+                        L3->dump_set_stats(out, "L3", false);
+                    }
+                    else
+                    {
+                        L1->dump_region_stats(out, "L1", true);
+                        L2->dump_region_stats(out, "L2", false);
+                        L3->dump_region_stats(out, "L3", false);
+                    }
+                    if (!file.empty())
+                        cout << "Written to " << file << "\n";
+                }
+                else if (cmd == "victim")
+                {
+                    size_t entries;
+                    if (!L1 || !(ss >> entries))
+                    {
+                        cout << "Usage: victim <entries> (after init, 0 = off)\n";
+                        continue;
+                    }
+                    L1->set_victim_cache(entries);
+                    L2->set_victim_cache(entries);
+                    L3->set_victim_cache(entries);
+                    cout << "Victim cache of " << entries << " lines per level\n";
+                }
+                else if (cmd == "region_size")
+                {
+                    size_t bytes;
+                    if (!L1 || !(ss >> bytes) || bytes == 0)
+                    {
+                        cout << "Usage: region_size <bytes> (after init)\n";
+                        continue;
+                    }
+                    L1->set_region_size(bytes);
+                    L2->set_region_size(bytes);
+                    L3->set_region_size(bytes);
+                    cout << "Region size set to " << bytes << " bytes\n";
                 }
 
                 // -------- EXIT --------
@@ -272,6 +561,15 @@ int main()
                     cout << "init -> initialize L1, L2, L3 caches" << "\n";
                     cout << "access <addr> -> access a physical address" << "\n";
                     cout << "stats ->show cache statistics" << "\n";
+                    cout << "export json|csv [file] -> counters, gauges and latency histograms" << "\n";
+                    cout << "heatmap [file] -> per set hits/misses/evictions/reuse csv (make INSTRUMENT=1)" << "\n";
+                    cout << "regions [file] -> per address region csv (make INSTRUMENT=1)" << "\n";
+                    cout << "region_size <bytes> -> size of an address region (default 4096)" << "\n";
+                    cout << "victim <entries> -> fully associative victim cache per level (0 = off)" << "\n";
+                    cout << "dram on|off -> banked DRAM with row buffers behind L3 (off: flat latency)" << "\n";
+                    cout << "dram geometry <ch> <ranks> <banks> <row bytes> | timing <tCAS> <tRCD> <tRP> <burst>" << "\n";
+                    cout << "dram policy open|closed | sched fcfs|frfcfs -> row buffer and scheduling policy" << "\n";
+                    cout << "dram replay <n> -> replay the RAM accesses with n misses in flight, FCFS vs FR-FCFS" << "\n";
                     cout << "exit ->go back to main menu" << "\n";
                 }
                 else
@@ -340,11 +638,18 @@ int main()
                 {
                     buddy.dump();
                 }
+                else if (cmd == "export")
+                {
+                    StatsRegistry registry;
+                    buddy.register_stats(registry, "buddy");
+                    export_stats(ss, registry);
+                }
                 else if (cmd == "help")
                 {
                     cout << "alloc <size>     : Allocate memory\n";
                     cout << "free <address>   : Free memory block\n";
                     cout << "dump             : Show allocator state\n";
+                    cout << "export json|csv [file] : Export counters and histograms\n";
                     cout << "back             : Return to previous menu\n";
                 }
                 else if (cmd == "back")
@@ -383,11 +688,13 @@ int main()
             cout << "Page size (bytes): ";
             cin >> page_size;
 
-            cout << "Page Replacement Policy (0=FIFO, 1=LRU, 2=CLOCK): ";
+            cout << "Page Replacement Policy (0=FIFO, 1=LRU, 2=CLOCK, 3=AGING, 4=WSCLOCK): ";
             cin >> policy;
 
             PageReplacement pr =
                 (policy == 0) ? PageReplacement::FIFO : (policy == 1) ? PageReplacement::LRU
+                                                    : (policy == 3)   ? PageReplacement::AGING
+                                                    : (policy == 4)   ? PageReplacement::WSCLOCK
                                                                       : PageReplacement::CLOCK;
 
             VirtualMemory vm(
@@ -402,6 +709,13 @@ int main()
 
             cout << "\nVirtual Memory initialized successfully\n";
 
+            /* ---------- STANDARD TLB CONFIG ---------- */
+            TlbConfig dtlb_cfg = {16, 4, ReplacementPolicy::LRU, 1, 1};   // 64 entry L1 dTLB
+            TlbConfig stlb_cfg = {128, 12, ReplacementPolicy::LRU, 7, 7}; // 1536 entry STLB
+            bool tlb_asid = true;
+            uint64_t walk_latency = 20; // cycles per page-table level
+            vm.configure_tlb(dtlb_cfg, stlb_cfg, tlb_asid, walk_latency);
+
             /* ---------- STANDARD CACHE CONFIG ---------- */
             const uint64_t RAM_LATENCY = 100;
 
@@ -428,6 +742,11 @@ int main()
                 20);
 
             uint64_t total_cycles = 0;
+            vector<SwapKey> history; // reference string for the OPT bound
+            DramConfig dram_cfg = default_dram_config();
+            unique_ptr<DramController> dram; // null = flat RAM_LATENCY
+            vector<uint64_t> ram_trace; // physical addresses that went to DRAM, for dram replay
+            Histogram access_latency; // cycles per access, translation included
 
             cin.ignore();
 
@@ -446,15 +765,30 @@ int main()
                 {
                     int pid;
                     uint64_t va;
-                    ss >> pid >> va;
+                    string mode;
+                    ss >> pid >> va >> mode;
+                    bool write = (mode == "w");
 
-                    if (pid < 0 || pid >= (int)num_processes)
+                    if (!vm.process(pid))
                     {
                         cout << "Invalid PID\n";
                         continue;
                     }
 
-                    uint64_t pa = vm.translate(pid, va);
+                    uint64_t pa;
+                    uint64_t start_cycles = total_cycles;
+                    uint64_t vm_cycles_before = vm.cycles();
+                    try
+                    {
+                        pa = vm.translate(pid, va, write);
+                    }
+                    catch (const exception &e)
+                    {
+                        cout << e.what() << "\n";
+                        continue;
+                    }
+                    total_cycles += vm.cycles() - vm_cycles_before; // TLB, page walk and swap I/O
+                    history.push_back({pid, va / page_size});
                     cout << "Physical Address = " << pa << "\n";
 
                     if (L1.access(pa))
@@ -477,13 +811,30 @@ int main()
                     }
                     else
                     {
-                        total_cycles += L1.latency() + L2.latency() +
-                                        L3.latency() + RAM_LATENCY;
+                        total_cycles += L1.latency() + L2.latency() + L3.latency();
+                        uint64_t ram_latency = RAM_LATENCY;
+                        if (dram)
+                        {
+                            ram_latency = dram->access(pa, total_cycles);
+                            ram_trace.push_back(pa);
+                        }
+                        if (const NumaTopology *numa = vm.numa_topology())
+                        {
+                            // the node latency replaces the flat cost, with DRAM only the remote hop is added
+                            int home = vm.process(pid)->home_node;
+                            uint64_t node_latency = vm.memory_latency(pid, pa);
+                            if (!dram)
+                                ram_latency = node_latency;
+                            else if (node_latency > numa->latency(home, home))
+                                ram_latency += node_latency - numa->latency(home, home);
+                        }
+                        total_cycles += ram_latency;
                         L3.access(pa);
                         L2.access(pa);
                         L1.access(pa);
                         cout << "MISS -> RAM ACCESS\n";
                     }
+                    access_latency.record(total_cycles - start_cycles);
                 }
 
                 // -------- STATS --------
@@ -492,19 +843,673 @@ int main()
                     cout << "\n--- VIRTUAL MEMORY STATS ---\n";
                     cout << "Page Hits: " << vm.page_hits << "\n";
                     cout << "Page Faults: " << vm.page_faults << "\n";
+                    cout << "Page-table nodes: " << vm.page_table_nodes()
+                         << " (" << vm.page_table_bytes() << " bytes simulated, "
+                         << vm.page_table_host_bytes() << " bytes host)\n";
+                    cout << "Average walk depth: " << vm.average_walk_depth() << "\n";
+
+                    cout << "Major faults (read from swap): " << vm.major_faults << "\n";
+                    cout << "Dirty write-backs: " << vm.writebacks
+                         << " Clean evictions: " << vm.clean_evictions << "\n";
+                    cout << "Fault service cycles: " << vm.fault_cycles << "\n";
+                    if (vm.readahead_size() > 0 || vm.readahead_pages > 0)
+                    {
+                        cout << "Readahead window: " << vm.readahead_size() << " pages"
+                             << " Prefetched: " << vm.readahead_pages
+                             << " Hits: " << vm.readahead_hits
+                             << " Wasted: " << vm.readahead_wasted << "\n";
+                        cout << "Faults avoided by readahead: " << vm.readahead_hits
+                             << " Fault cycles saved: " << vm.readahead_saved_cycles << "\n";
+                    }
+                    if (vm.huge_faults > 0 || vm.huge_fallbacks > 0 || vm.thp_enabled())
+                    {
+                        cout << "Huge page faults: " << vm.huge_faults
+                             << " Fallbacks to base pages: " << vm.huge_fallbacks << "\n";
+                        cout << "THP promotions: " << vm.thp_promotions
+                             << " Failed (no free run): " << vm.thp_failures << "\n";
+                        cout << "Resident huge pages: " << vm.huge_pages_resident(HUGE_2M_LEVEL) << " x 2M-class, "
+                             << vm.huge_pages_resident(HUGE_1G_LEVEL) << " x 1G-class\n";
+                    }
+                    if (vm.cow_faults > 0 || vm.shared_faults > 0 || vm.frames_saved() > 0)
+                    {
+                        cout << "COW faults: " << vm.cow_faults << " Copies: " << vm.cow_copies
+                             << " Shared segment faults: " << vm.shared_faults << "\n";
+                        cout << "Frames saved by sharing: " << vm.frames_saved()
+                             << " (" << vm.frames_saved() * page_size << " bytes)\n";
+                    }
+                    if (vm.buddy_enabled())
+                        cout << "Buddy free frames: " << vm.frame_allocator()->free_size()
+                             << " Largest free block: " << vm.frame_allocator()->largest_free_block() << " frames\n";
+                    auto &orders = vm.allocation_orders();
+                    for (size_t k = 0; k < orders.size(); k++)
+                    {
+                        if (orders[k].requests == 0)
+                            continue;
+                        cout << "Order " << k << " (" << (1ull << k) << " frames): " << orders[k].requests << " requests, "
+                             << orders[k].from_free << " free, " << orders[k].reclaimed << " after reclaim, "
+                             << orders[k].failures << " failed";
+                        if (orders[k].failures > 0)
+                            cout << " (first at reference " << orders[k].first_failure << ")";
+                        cout << "\n";
+                    }
+                    if (const NumaTopology *numa = vm.numa_topology())
+                    {
+                        uint64_t local = 0, remote = 0;
+                        for (int pid = 0; pid < (int)num_processes; pid++)
+                            if (const Process *p = vm.process(pid))
+                            {
+                                local += p->local_refs;
+                                remote += p->remote_refs;
+                            }
+                        cout << "NUMA nodes: " << numa->nodes() << " Free frames per node:";
+                        for (int n = 0; n < (int)numa->nodes(); n++)
+                            cout << " " << vm.node_free_frames(n);
+                        cout << "\n";
+                        cout << "Local references: " << local << " Remote: " << remote
+                             << " (" << (local + remote ? 100.0 * remote / (local + remote) : 0.0) << "% remote)\n";
+                        cout << "Placement fallbacks: " << vm.numa_fallbacks
+                             << " Migrations: " << vm.numa_migrations
+                             << " Skipped (node full): " << vm.numa_migration_failures << "\n";
+                    }
+                    cout << "Frame memory in use: " << vm.resident_bytes() << " bytes\n";
+                    cout << "Swap pages: " << vm.backing_store().pages()
+                         << " (" << vm.backing_store().bytes() << " bytes"
+                         << (vm.backing_store().file().empty() ? ", in memory" : ", file " + vm.backing_store().file())
+                         << ")\n";
+
+                    if (vm.dtlb())
+                    {
+                        cout << "\n--- TLB STATS ---\n";
+                        cout << "dTLB Hits: " << vm.dtlb()->hits << " Misses: " << vm.dtlb()->misses
+                             << " (reach " << vm.dtlb()->entries() * vm.page_bytes() << " bytes)\n";
+                        cout << "STLB Hits: " << vm.stlb()->hits << " Misses: " << vm.stlb()->misses
+                             << " (reach " << vm.stlb()->entries() * vm.page_bytes() << " bytes)\n";
+                        cout << "Page walks: " << vm.page_walks << " Walk cycles: " << vm.walk_cycles << "\n";
+                        cout << "TLB flushes: " << vm.tlb_flushes << "\n";
+                        cout << "Translation cycles: " << vm.translation_cycles << "\n";
+                    }
 
                     cout << "\n--- CACHE STATS ---\n";
                     cout << "L1 Hits: " << L1.hits << " Misses: " << L1.misses << "\n";
                     cout << "L2 Hits: " << L2.hits << " Misses: " << L2.misses << "\n";
                     cout << "L3 Hits: " << L3.hits << " Misses: " << L3.misses << "\n";
                     cout << "Total Cycles: " << total_cycles << "\n";
+                    if (dram)
+                        print_dram_stats(*dram);
+                }
+                else if (cmd == "dram")
+                {
+                    dram_command(ss, dram_cfg, dram, ram_trace);
+                }
+
+                // -------- REPLACEMENT --------
+                else if (cmd == "opt")
+                {
+                    uint64_t opt = opt_page_faults(history, num_frames);
+                    cout << "OPT faults on the " << history.size() << " references so far: " << opt << "\n";
+                    cout << "Current policy faults: " << vm.page_faults
+                         << " (gap " << (int64_t)vm.page_faults - (int64_t)opt << ")\n";
+                }
+                else if (cmd == "aging" || cmd == "tau")
+                {
+                    uint64_t refs;
+                    if (!(ss >> refs))
+                    {
+                        cout << "Usage: aging <references per tick> | tau <working set window>\n";
+                        continue;
+                    }
+                    if (cmd == "aging")
+                        vm.set_aging_interval(refs);
+                    else
+                        vm.set_ws_tau(refs);
+                    cout << (cmd == "aging" ? "Aging interval" : "Working set window") << " set to " << refs << " references\n";
+                }
+
+                else if (cmd == "readahead")
+                {
+                    string first;
+                    size_t lo = 0, hi = 0;
+                    ss >> first;
+                    if (first != "off")
+                    {
+                        stringstream args(first);
+                        if (!(args >> lo) || !(ss >> hi) || lo > hi)
+                        {
+                            cout << "Usage: readahead <min pages> <max pages> | readahead off\n";
+                            continue;
+                        }
+                    }
+                    vm.set_readahead(lo, hi);
+                    if (hi == 0)
+                        cout << "Readahead disabled\n";
+                    else
+                        cout << "Readahead window " << vm.readahead_size() << " pages, adapts up to " << hi << "\n";
+                }
+
+                // -------- RESIDENT SET QUOTAS --------
+                else if (cmd == "quota")
+                {
+                    string what;
+                    uint64_t frames;
+                    ss >> what;
+                    if (what == "equal" || what == "proportional" || what == "priority" || what == "off")
+                    {
+                        vm.allocate_frames(what == "equal"          ? FrameAllocation::EQUAL
+                                           : what == "proportional" ? FrameAllocation::PROPORTIONAL
+                                           : what == "priority"     ? FrameAllocation::PRIORITY
+                                                                    : FrameAllocation::NONE);
+                        cout << "Frame quotas: " << what << "\n";
+                        continue;
+                    }
+                    stringstream args(what);
+                    int pid;
+                    if (!(args >> pid) || !(ss >> frames))
+                    {
+                        cout << "Usage: quota <pid> <frames> | quota equal|proportional|priority|off\n";
+                        continue;
+                    }
+                    try
+                    {
+                        vm.set_quota(pid, frames);
+                        cout << "PID " << pid << " quota " << frames << " frames\n";
+                    }
+                    catch (const exception &e)
+                    {
+                        cout << e.what() << "\n";
+                    }
+                }
+                else if (cmd == "priority")
+                {
+                    int pid;
+                    unsigned weight;
+                    if (!(ss >> pid >> weight))
+                    {
+                        cout << "Usage: priority <pid> <weight>\n";
+                        continue;
+                    }
+                    try
+                    {
+                        vm.set_priority(pid, weight);
+                        cout << "PID " << pid << " priority " << weight << "\n";
+                    }
+                    catch (const exception &e)
+                    {
+                        cout << e.what() << "\n";
+                    }
+                }
+                else if (cmd == "scope")
+                {
+                    string mode;
+                    ss >> mode;
+                    if (mode != "local" && mode != "global")
+                    {
+                        cout << "Usage: scope local|global\n";
+                        continue;
+                    }
+                    vm.set_scope(mode == "local" ? ReplacementScope::LOCAL : ReplacementScope::GLOBAL);
+                    cout << "Replacement scope: " << mode << "\n";
+                }
+                else if (cmd == "procstats")
+                {
+                    cout << "\n--- PER PROCESS STATS ("
+                         << (vm.replacement_scope() == ReplacementScope::LOCAL ? "local" : "global")
+                         << " replacement) ---\n";
+                    for (int pid = 0; pid < (int)num_processes; pid++)
+                    {
+                        const Process *p = vm.process(pid);
+                        if (!p)
+                            continue;
+                        uint64_t refs = p->hits + p->faults;
+                        cout << "PID " << pid << ": Faults " << p->faults
+                             << " Hits " << p->hits
+                             << " Fault rate " << (refs ? (double)p->faults / refs : 0.0)
+                             << " RSS " << p->resident_pages << " frames"
+                             << " Quota ";
+                        if (p->quota)
+                            cout << p->quota;
+                        else
+                            cout << "none";
+                        cout << " Priority " << p->priority
+                             << " COW faults " << p->cow_faults;
+                        if (vm.numa_topology())
+                            cout << " Node " << p->home_node
+                                 << (p->numa_policy == NumaPolicy::LOCAL        ? " local"
+                                     : p->numa_policy == NumaPolicy::INTERLEAVE ? " interleave"
+                                                                                : " preferred")
+                                 << " Remote refs " << p->remote_refs << "/" << p->local_refs + p->remote_refs;
+                        cout << "\n";
+                    }
+                }
+
+                // -------- SHARING --------
+                else if (cmd == "fork")
+                {
+                    int parent, child;
+                    if (!(ss >> parent >> child))
+                    {
+                        cout << "Usage: fork <parent pid> <child pid>\n";
+                        continue;
+                    }
+                    try
+                    {
+                        vm.fork(parent, child);
+                        num_processes = max(num_processes, (size_t)child + 1);
+                        cout << "PID " << child << " forked from PID " << parent
+                             << " (" << vm.process(child)->resident_pages << " pages shared copy-on-write)\n";
+                    }
+                    catch (const exception &e)
+                    {
+                        cout << e.what() << "\n";
+                    }
+                }
+                else if (cmd == "share")
+                {
+                    int pid, segment;
+                    uint64_t va, length;
+                    if (!(ss >> pid >> va >> length >> segment))
+                    {
+                        cout << "Usage: share <pid> <va> <length> <segment>\n";
+                        continue;
+                    }
+                    try
+                    {
+                        vm.map_shared(pid, va, length, segment);
+                        cout << "Segment " << segment << " mapped at VA " << va << " of PID " << pid << "\n";
+                    }
+                    catch (const exception &e)
+                    {
+                        cout << e.what() << "\n";
+                    }
+                }
+                else if (cmd == "cowcost")
+                {
+                    uint64_t cycles;
+                    if (!(ss >> cycles))
+                    {
+                        cout << "Usage: cowcost <cycles>\n";
+                        continue;
+                    }
+                    vm.set_cow_cost(cycles);
+                    cout << "Copy-on-write copy: " << cycles << " cycles\n";
+                }
+
+                // -------- HUGE PAGES --------
+                else if (cmd == "hugepage")
+                {
+                    int pid;
+                    uint64_t va, length;
+                    string size;
+                    if (!(ss >> pid >> va >> length >> size) || (size != "2m" && size != "1g"))
+                    {
+                        cout << "Usage: hugepage <pid> <va> <length> <2m|1g>\n";
+                        continue;
+                    }
+                    int level = (size == "2m") ? HUGE_2M_LEVEL : HUGE_1G_LEVEL;
+                    try
+                    {
+                        vm.map_huge(pid, va, length, level);
+                        cout << "Huge pages of " << pages_at_level(level) * page_size
+                             << " bytes back pid " << pid << " from VA " << va << "\n";
+                    }
+                    catch (const exception &e)
+                    {
+                        cout << e.what() << "\n";
+                    }
+                }
+                else if (cmd == "thp")
+                {
+                    string mode;
+                    ss >> mode;
+                    if (mode != "on" && mode != "off")
+                    {
+                        cout << "Usage: thp on|off\n";
+                        continue;
+                    }
+                    vm.set_thp(mode == "on");
+                    cout << "Transparent huge pages " << mode << "\n";
+                }
+
+                // -------- PHYSICAL FRAMES --------
+                else if (cmd == "frames")
+                {
+                    string mode;
+                    ss >> mode;
+                    if (mode != "buddy")
+                    {
+                        cout << "Usage: frames buddy\n";
+                        continue;
+                    }
+                    try
+                    {
+                        vm.use_buddy();
+                        cout << "Frames come from a buddy allocator\n";
+                    }
+                    catch (const exception &e)
+                    {
+                        cout << e.what() << "\n";
+                    }
+                }
+                else if (cmd == "dma")
+                {
+                    uint64_t frames;
+                    if (!(ss >> frames))
+                    {
+                        cout << "Usage: dma <frames>\n";
+                        continue;
+                    }
+                    try
+                    {
+                        int first = vm.dma_alloc(frames);
+                        if (first == -1)
+                            cout << "No contiguous run of " << frames << " frames could be freed\n";
+                        else
+                            cout << "DMA buffer at frame " << first << " (PA " << (uint64_t)first * page_size << ")\n";
+                    }
+                    catch (const exception &e)
+                    {
+                        cout << e.what() << "\n";
+                    }
+                }
+                else if (cmd == "dmafree")
+                {
+                    int first;
+                    if (!(ss >> first))
+                    {
+                        cout << "Usage: dmafree <first frame>\n";
+                        continue;
+                    }
+                    try
+                    {
+                        vm.dma_free(first);
+                        cout << "DMA buffer at frame " << first << " freed\n";
+                    }
+                    catch (const exception &e)
+                    {
+                        cout << e.what() << "\n";
+                    }
+                }
+
+                // -------- NUMA --------
+                else if (cmd == "numa")
+                {
+                    string what;
+                    ss >> what;
+                    try
+                    {
+                        if (what == "latency")
+                        {
+                            int from, to;
+                            uint64_t cycles;
+                            if (!(ss >> from >> to >> cycles))
+                            {
+                                cout << "Usage: numa latency <cpu node> <memory node> <cycles>\n";
+                                continue;
+                            }
+                            vm.set_numa_latency(from, to, cycles);
+                            cout << "Node " << from << " -> node " << to << " memory: " << cycles << " cycles\n";
+                        }
+                        else if (what == "home")
+                        {
+                            int pid, node;
+                            if (!(ss >> pid >> node))
+                            {
+                                cout << "Usage: numa home <pid> <node>\n";
+                                continue;
+                            }
+                            vm.set_home_node(pid, node);
+                            cout << "PID " << pid << " runs on node " << node << "\n";
+                        }
+                        else if (what == "policy")
+                        {
+                            int pid, node = 0;
+                            string mode;
+                            ss >> pid >> mode;
+                            if (!ss || (mode != "local" && mode != "interleave" &&
+                                        (mode != "preferred" || !(ss >> node))))
+                            {
+                                cout << "Usage: numa policy <pid> local|interleave|preferred <node>\n";
+                                continue;
+                            }
+                            vm.set_numa_policy(pid, mode == "local"        ? NumaPolicy::LOCAL
+                                                    : mode == "interleave" ? NumaPolicy::INTERLEAVE
+                                                                           : NumaPolicy::PREFERRED,
+                                               node);
+                            cout << "PID " << pid << " memory policy " << mode << "\n";
+                        }
+                        else if (what == "migrate")
+                        {
+                            string arg;
+                            uint64_t refs = 0, cycles = 2000;
+                            ss >> arg;
+                            stringstream args(arg);
+                            if (arg != "off" && (!(args >> refs) || refs == 0))
+                            {
+                                cout << "Usage: numa migrate <remote refs> [cycles] | numa migrate off\n";
+                                continue;
+                            }
+                            ss >> cycles;
+                            vm.set_numa_migration(refs, cycles);
+                            if (refs)
+                                cout << "Pages migrate after " << refs << " remote references in a row ("
+                                     << cycles << " cycles each)\n";
+                            else
+                                cout << "Page migration off\n";
+                        }
+                        else
+                        {
+                            stringstream args(what);
+                            size_t nodes;
+                            uint64_t local = RAM_LATENCY, remote = 2 * RAM_LATENCY;
+                            if (!(args >> nodes) || nodes == 0)
+                            {
+                                cout << "Usage: numa <nodes> [local cycles] [remote cycles] | numa latency|home|policy|migrate ...\n";
+                                continue;
+                            }
+                            ss >> local >> remote;
+                            vm.use_numa(nodes, local, remote);
+                            cout << nodes << " NUMA nodes of " << num_frames / nodes << " frames, memory "
+                                 << local << " cycles local / " << remote << " remote\n";
+                        }
+                    }
+                    catch (const exception &e)
+                    {
+                        cout << e.what() << "\n";
+                    }
+                }
+
+                // -------- SWAP --------
+                else if (cmd == "swapdev")
+                {
+                    SwapDevice dev;
+                    if (!(ss >> dev.latency >> dev.bytes_per_cycle) || dev.bytes_per_cycle <= 0)
+                    {
+                        cout << "Usage: swapdev <latency cycles> <bytes per cycle>\n";
+                        continue;
+                    }
+                    vm.set_swap_device(dev);
+                    cout << "Swap device: " << dev.latency << " cycles + " << dev.bytes_per_cycle << " bytes/cycle\n";
+                }
+                else if (cmd == "swapfile")
+                {
+                    string path;
+                    if (!(ss >> path))
+                    {
+                        cout << "Usage: swapfile <path>\n";
+                        continue;
+                    }
+                    try
+                    {
+                        vm.use_swap_file(path);
+                        cout << "Swapping to " << path << "\n";
+                    }
+                    catch (const exception &e)
+                    {
+                        cout << e.what() << "\n";
+                    }
+                }
+
+                // -------- TLB --------
+                else if (cmd == "tlb")
+                {
+                    string what;
+                    ss >> what;
+                    if (what == "off")
+                    {
+                        vm.disable_tlb();
+                        cout << "TLB simulation disabled\n";
+                        continue;
+                    }
+                    if (what == "l1" || what == "l2")
+                    {
+                        TlbConfig cfg;
+                        string pol;
+                        if (!(ss >> cfg.sets >> cfg.ways >> pol >> cfg.hit_latency >> cfg.miss_latency) ||
+                            cfg.sets == 0 || cfg.ways == 0 ||
+                            (pol != "fifo" && pol != "lru" && pol != "lfu"))
+                        {
+                            cout << "Usage: tlb l1|l2 <sets> <ways> <fifo|lru|lfu> <hit_latency> <miss_latency>\n";
+                            continue;
+                        }
+                        cfg.policy = (pol == "fifo") ? ReplacementPolicy::FIFO : (pol == "lru") ? ReplacementPolicy::LRU
+                                                                                                : ReplacementPolicy::LFU;
+                        (what == "l1" ? dtlb_cfg : stlb_cfg) = cfg;
+                    }
+                    else if (what == "asid")
+                    {
+                        string mode;
+                        ss >> mode;
+                        tlb_asid = (mode == "on");
+                    }
+                    else if (what == "walk")
+                    {
+                        if (!(ss >> walk_latency))
+                        {
+                            cout << "Usage: tlb walk <cycles per level>\n";
+                            continue;
+                        }
+                    }
+                    else if (what != "on")
+                    {
+                        cout << "Usage: tlb on|off|l1|l2|asid|walk ...\n";
+                        continue;
+                    }
+                    vm.configure_tlb(dtlb_cfg, stlb_cfg, tlb_asid, walk_latency);
+                    cout << "TLB: dTLB " << dtlb_cfg.sets << "x" << dtlb_cfg.ways
+                         << ", STLB " << stlb_cfg.sets << "x" << stlb_cfg.ways
+                         << ", ASID " << (tlb_asid ? "on" : "off")
+                         << ", walk " << walk_latency << " cycles/level\n";
+                }
+
+                // -------- CONCURRENCY --------
+                else if (cmd == "mtscale")
+                {
+                    // thread t replays the stream of process t against one shared set of frames
+                    string first;
+                    ss >> first;
+                    vector<vector<vector<uint64_t>>> runs;
+                    if (first == "trace")
+                    {
+                        vector<vector<uint64_t>> streams(num_processes);
+                        for (auto &ref : history)
+                            streams[ref.pid].push_back(ref.vpn * page_size);
+                        runs.push_back(streams);
+                    }
+                    else
+                    {
+                        stringstream args(first);
+                        size_t max_threads;
+                        uint64_t refs = 100000;
+                        if (!(args >> max_threads) || max_threads == 0 || (ss >> refs && refs == 0))
+                        {
+                            cout << "Usage: mtscale <max threads> [refs per thread] | mtscale trace\n";
+                            continue;
+                        }
+                        // 90% of the references go to a hot eighth of the address space
+                        uint64_t hot = max<uint64_t>(1, pages_per_process / 8);
+                        for (size_t threads = 1; threads <= max_threads; threads *= 2)
+                        {
+                            vector<vector<uint64_t>> streams(threads);
+                            for (size_t t = 0; t < threads; t++)
+                            {
+                                mt19937_64 rng(t + 1);
+                                for (uint64_t i = 0; i < refs; i++)
+                                {
+                                    uint64_t page = (rng() % 10 != 0) ? rng() % hot : rng() % pages_per_process;
+                                    streams[t].push_back(page * page_size + rng() % page_size);
+                                }
+                            }
+                            runs.push_back(streams);
+                        }
+                    }
+
+                    cout << "Threads  References  Faults  Evictions  Busy skips  Seconds  Faults/s  Refs/s\n";
+                    for (auto &streams : runs)
+                    {
+                        ScalePoint p = replay_concurrent(num_frames, page_size, pages_per_process, streams);
+                        double secs = p.seconds > 0 ? p.seconds : 1e-9;
+                        cout << p.threads << "  " << p.references << "  " << p.totals.faults
+                             << "  " << p.totals.evictions << "  " << p.totals.busy_skips
+                             << "  " << p.seconds << "  " << (uint64_t)(p.totals.faults / secs)
+                             << "  " << (uint64_t)(p.references / secs) << "\n";
+                    }
+                }
+
+                // -------- STATS EXPORT --------
+                else if (cmd == "export")
+                {
+                    StatsRegistry registry;
+                    registry.counter("total_cycles", &total_cycles);
+                    registry.histogram("access.latency", &access_latency);
+                    vm.register_stats(registry, "vm");
+                    L1.register_stats(registry, "l1");
+                    L2.register_stats(registry, "l2");
+                    L3.register_stats(registry, "l3");
+                    if (dram)
+                        dram->register_stats(registry, "dram");
+                    export_stats(ss, registry);
                 }
 
                 // -------- HELP --------
                 else if (cmd == "help")
                 {
-                    cout << "access <pid> <va>  : Access virtual address\n";
+                    cout << "access <pid> <va> [r|w] : Read (default) or write a virtual address\n";
                     cout << "stats              : Show VM and cache stats\n";
+                    cout << "export json|csv [file] : Counters, gauges and latency histograms of every module\n";
+                    cout << "opt                : Belady OPT faults for the accesses so far\n";
+                    cout << "aging <refs>       : References between AGING ticks (default 8)\n";
+                    cout << "tau <refs>         : WSCLOCK working set window (default 4 x frames)\n";
+                    cout << "readahead <min> <max> | off : Adaptive fault-around window in pages\n";
+                    cout << "procstats          : Faults and resident set size per PID\n";
+                    cout << "quota <pid> <frames> : Resident set limit of a process (0 = none)\n";
+                    cout << "quota equal|proportional|priority|off : Split all frames into quotas\n";
+                    cout << "priority <pid> <w> : Weight for priority quotas (default 1)\n";
+                    cout << "scope local|global : Victims from the faulting process or from any process\n";
+                    cout << "fork <parent> <child> : Copy-on-write fork into a new PID\n";
+                    cout << "share <pid> <va> <len> <seg> : Map a shared segment (copy on write)\n";
+                    cout << "cowcost <cycles>   : Cost of a copy-on-write page copy (default 2000)\n";
+                    cout << "hugepage <pid> <va> <len> <2m|1g> : Back a range with huge pages on fault\n";
+                    cout << "thp on|off         : Collapse fully resident 512 page ranges into huge pages\n";
+                    cout << "frames buddy       : Allocate frames from a buddy allocator (before any access)\n";
+                    cout << "dma <frames>       : Pin a physically contiguous run (needs frames buddy)\n";
+                    cout << "dmafree <frame>    : Release a DMA run by its first frame\n";
+                    cout << "numa <nodes> [local] [remote] : Split frames into NUMA nodes (before any access)\n";
+                    cout << "numa latency <cpu> <mem> <cycles> : Memory latency between two nodes\n";
+                    cout << "numa home <pid> <node> : Node a process runs on (default pid % nodes)\n";
+                    cout << "numa policy <pid> local|interleave|preferred <node> : Where new pages go\n";
+                    cout << "numa migrate <refs> [cycles] | off : Move pages after remote references in a row\n";
+                    cout << "swapdev <lat> <bw> : Swap device latency (cycles) and bandwidth (bytes/cycle)\n";
+                    cout << "swapfile <path>    : Swap into a sparse mmap'd file (before any page out)\n";
+                    cout << "tlb on|off         : Enable / disable TLB simulation (on by default)\n";
+                    cout << "tlb l1|l2 <sets> <ways> <policy> <hit_lat> <miss_lat> : Configure a TLB level\n";
+                    cout << "tlb asid on|off    : Tag entries with pid instead of flushing on switch\n";
+                    cout << "tlb walk <cycles>  : Cycles per page-table level on a page walk\n";
+                    cout << "mtscale <threads> [refs] : Fault throughput of the thread-safe engine, 1..threads\n";
+                    cout << "mtscale trace      : Replay the accesses so far, one thread per PID\n";
+                    cout << "dram on|off        : Banked DRAM with row buffers behind L3 (off: flat latency)\n";
+                    cout << "dram geometry <ch> <ranks> <banks> <row bytes> : DRAM organisation\n";
+                    cout << "dram timing <tCAS> <tRCD> <tRP> <burst> : DRAM timings in cycles\n";
+                    cout << "dram policy open|closed / dram sched fcfs|frfcfs : Row buffer and scheduling policy\n";
+                    cout << "dram replay <n>    : Replay the RAM accesses with n misses in flight, FCFS vs FR-FCFS\n";
                     cout << "exit               : Exit simulator\n";
                 }
 
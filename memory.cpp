@@ -1,10 +1,15 @@
 #include "include/memory.h"
+#include "include/event_trace.h"
+#include "include/checkpoint.h"
+#include <stdexcept>
 #include <iostream>
 #include <sstream>
+#include <atomic>
 
-static size_t alloc_requests = 0;
-static size_t alloc_success = 0;
-static size_t alloc_failure = 0;
+// shared by every PhysicalMemory, atomic so batch sweeps can run allocators in parallel
+static std::atomic<size_t> alloc_requests(0);
+static std::atomic<size_t> alloc_success(0);
+static std::atomic<size_t> alloc_failure(0);
 
 PhysicalMemory::PhysicalMemory(size_t size)
 {
@@ -16,7 +21,9 @@ PhysicalMemory::PhysicalMemory(size_t size)
 
 int PhysicalMemory::allocate_first_fit(size_t req_size)
 {
+    SIM_PROFILE(HEAP_ALLOCATE);
     alloc_requests++;
+    request_sizes.record(req_size);
     for (auto it = blocks.begin(); it != blocks.end(); ++it)
     {
         if (it->free && it->size >= req_size)
@@ -34,6 +41,7 @@ int PhysicalMemory::allocate_first_fit(size_t req_size)
                 // Split block
                 Block allocated = {it->start, req_size, false, id};
                 Block remaining = {it->start + req_size, it->size - req_size, true, -1};
+                SIM_EVENT(ALLOC_SPLIT, EVENT_UNIT_HEAP, remaining.start, remaining.size);
                 it = blocks.erase(it);        // erase the original block
                 blocks.insert(it, remaining); // inserts the block
                 blocks.insert(it, allocated); // insert the block
@@ -42,12 +50,15 @@ int PhysicalMemory::allocate_first_fit(size_t req_size)
         }
     }
     alloc_failure++;
+    SIM_EVENT(ALLOC_FAIL, EVENT_UNIT_HEAP, req_size, 0);
     return -1; // Allocation failed
 }
 
 int PhysicalMemory::allocate_best_fit(size_t req_size)
 {
+    SIM_PROFILE(HEAP_ALLOCATE);
     alloc_requests++;
+    request_sizes.record(req_size);
     auto best = blocks.end();
     for (auto it = blocks.begin(); it != blocks.end(); ++it)
     {
@@ -62,6 +73,7 @@ int PhysicalMemory::allocate_best_fit(size_t req_size)
     if (best == blocks.end())
     {
         alloc_failure++;
+        SIM_EVENT(ALLOC_FAIL, EVENT_UNIT_HEAP, req_size, 0);
         return -1; // no suitable block
     }
     int id = next_id++;
@@ -76,6 +88,7 @@ int PhysicalMemory::allocate_best_fit(size_t req_size)
         // Same process as above
         Block allocated = {best->start, req_size, false, id};
         Block remaining = {best->start + req_size, best->size - req_size, true, -1};
+        SIM_EVENT(ALLOC_SPLIT, EVENT_UNIT_HEAP, remaining.start, remaining.size);
         best = blocks.erase(best);
         blocks.insert(best, remaining);
         blocks.insert(best, allocated);
@@ -86,7 +99,9 @@ int PhysicalMemory::allocate_best_fit(size_t req_size)
 
 int PhysicalMemory::allocate_worst_fit(size_t req_size)
 {
+    SIM_PROFILE(HEAP_ALLOCATE);
     alloc_requests++;
+    request_sizes.record(req_size);
     auto worst = blocks.end();
 
     for (auto it = blocks.begin(); it != blocks.end(); ++it)
@@ -103,6 +118,7 @@ int PhysicalMemory::allocate_worst_fit(size_t req_size)
     if (worst == blocks.end())
     {
         alloc_failure++;
+        SIM_EVENT(ALLOC_FAIL, EVENT_UNIT_HEAP, req_size, 0);
         return -1;
     }
     int id = next_id++;
@@ -117,6 +133,7 @@ int PhysicalMemory::allocate_worst_fit(size_t req_size)
         // same process as above
         Block allocated = {worst->start, req_size, false, id};
         Block remaining = {worst->start + req_size, worst->size - req_size, true, -1};
+        SIM_EVENT(ALLOC_SPLIT, EVENT_UNIT_HEAP, remaining.start, remaining.size);
         worst = blocks.erase(worst);
         blocks.insert(worst, remaining);
         blocks.insert(worst, allocated);
@@ -126,6 +143,7 @@ int PhysicalMemory::allocate_worst_fit(size_t req_size)
 
 void PhysicalMemory::deallocate(int id)
 {
+    SIM_PROFILE(HEAP_FREE);
     for (auto it = blocks.begin(); it != blocks.end(); ++it)
     {
         if (!it->free && it->id == id)
@@ -139,6 +157,7 @@ void PhysicalMemory::deallocate(int id)
             {
                 it->size += next->size;
                 blocks.erase(next);
+                SIM_EVENT(ALLOC_MERGE, EVENT_UNIT_HEAP, it->start, it->size);
             }
             // Merge with previous block if free
             if (it != blocks.begin())
@@ -149,6 +168,7 @@ void PhysicalMemory::deallocate(int id)
                 {
                     prev->size += it->size;
                     blocks.erase(it);
+                    SIM_EVENT(ALLOC_MERGE, EVENT_UNIT_HEAP, prev->start, prev->size);
                 }
             }
             return;
@@ -156,6 +176,44 @@ void PhysicalMemory::deallocate(int id)
     }
 }
 
+void PhysicalMemory::checkpoint(CheckpointWriter &out) const
+{
+    out.begin("HEAP");
+    out.put(total_size);
+    out.put(next_id);
+    out.put(blocks.size());
+    for (const Block &b : blocks)
+    {
+        out.put(b.start);
+        out.put(b.size);
+        out.put_bool(b.free);
+        out.put_signed(b.id);
+    }
+    request_sizes.checkpoint(out);
+    out.end();
+}
+
+void PhysicalMemory::restore(CheckpointReader &in)
+{
+    in.begin("HEAP");
+    if (in.get() != total_size)
+        throw std::runtime_error("Checkpoint memory has a different size");
+    next_id = (int)in.get_below(INT32_MAX, "block id");
+    uint64_t n = in.get_below(total_size + 2, "block count");
+    blocks.clear();
+    for (uint64_t i = 0; i < n; i++)
+    {
+        Block b;
+        b.start = in.get_below(total_size + 1, "block start");
+        b.size = in.get_below(total_size + 1, "block size");
+        b.free = in.get_bool();
+        b.id = (int)in.get_signed();
+        blocks.push_back(b);
+    }
+    request_sizes.restore(in);
+    in.end();
+}
+
 // Values requuired to print
 void PhysicalMemory::dump() const
 {
@@ -188,3 +246,38 @@ void PhysicalMemory::dump() const
     std::cout << "Allocation success rate: " << success_rate << "%\n";
     std::cout << "Allocation failures: " << alloc_failure << "\n";
 }
+
+size_t PhysicalMemory::free_size() const
+{
+    size_t n = 0;
+    for (const auto &b : blocks)
+        if (b.free)
+            n += b.size;
+    return n;
+}
+
+size_t PhysicalMemory::largest_free_block() const
+{
+    size_t largest = 0;
+    for (const auto &b : blocks)
+        if (b.free && b.size > largest)
+            largest = b.size;
+    return largest;
+}
+
+void PhysicalMemory::register_stats(StatsRegistry &stats, const std::string &prefix) const
+{
+    stats.gauge(prefix + ".free_bytes", [this]() { return (double)free_size(); });
+    stats.gauge(prefix + ".largest_free_block", [this]() { return (double)largest_free_block(); });
+    stats.gauge(prefix + ".used_bytes", [this]() { return (double)(total_size - free_size()); });
+    stats.gauge(prefix + ".alloc_requests", []() { return (double)alloc_requests; });
+    stats.gauge(prefix + ".alloc_failures", []() { return (double)alloc_failure; });
+    stats.histogram(prefix + ".request_sizes", &request_sizes);
+    stats.distribution(prefix + ".free_blocks", [this]() {
+        Histogram h;
+        for (const auto &b : blocks)
+            if (b.free)
+                h.record(b.size);
+        return h;
+    });
+}
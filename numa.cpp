@@ -0,0 +1,40 @@
+#include "include/numa.h"
+#include <algorithm>
+#include <stdexcept>
+
+NumaTopology::NumaTopology(size_t nodes, size_t num_frames, uint64_t local_latency, uint64_t remote_latency)
+    : num_nodes(nodes),
+      frames_per_node(nodes == 0 ? 0 : num_frames / nodes)
+{
+    if (nodes == 0 || frames_per_node == 0)
+        throw std::invalid_argument("Every NUMA node needs at least one frame");
+    distance.assign(num_nodes * num_nodes, remote_latency);
+    for (size_t n = 0; n < num_nodes; n++)
+        distance[n * num_nodes + n] = local_latency;
+}
+
+int NumaTopology::node_of(int frame) const
+{
+    return (int)std::min((size_t)frame / frames_per_node, num_nodes - 1);
+}
+
+void NumaTopology::set_latency(int cpu_node, int memory_node, uint64_t cycles)
+{
+    if (cpu_node < 0 || memory_node < 0 || (size_t)cpu_node >= num_nodes || (size_t)memory_node >= num_nodes)
+        throw std::out_of_range("Invalid NUMA node");
+    distance[cpu_node * num_nodes + memory_node] = cycles;
+}
+
+std::vector<int> NumaTopology::fallback_order(int node) const
+{
+    std::vector<int> order(num_nodes);
+    for (size_t n = 0; n < num_nodes; n++)
+        order[n] = (int)n;
+    // stable: equally distant nodes in node order, node itself first on a tie
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        if (a == node || b == node)
+            return a == node && b != node;
+        return latency(node, a) < latency(node, b);
+    });
+    return order;
+}
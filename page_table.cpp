@@ -0,0 +1,219 @@
+#include "include/page_table.h"
+#include "include/checkpoint.h"
+#include <stdexcept>
+
+PageTableNode::PageTableNode()
+{
+    for (auto &e : entries)
+        e = {false, -1, 0, 0, false, false, false};
+}
+
+PageTable::PageTable()
+    : root(new PageTableNode()),
+      num_nodes(1),
+      walks(0),
+      walk_levels(0)
+{
+}
+
+size_t PageTable::index(uint64_t vpn, int level)
+{
+    return (vpn >> ((level - 1) * PT_INDEX_BITS)) & (PT_ENTRIES - 1);
+}
+
+PageTableEntry &PageTable::lookup(uint64_t vpn, int &level)
+{
+    PageTableEntry &e = entry(vpn, level);
+    walks++;
+    walk_levels += PT_LEVELS - level + 1; // tables read until the leaf
+    return e;
+}
+
+PageTableEntry &PageTable::entry(uint64_t vpn, int &level)
+{
+    PageTableNode *node = root.get();
+    // walk down from the root, tables are created only when a path is touched
+    for (level = PT_LEVELS; level > 1; level--)
+    {
+        size_t i = index(vpn, level);
+        if (node->entries[i].valid)
+            return node->entries[i]; // huge page
+        auto &child = node->children[i];
+        if (!child)
+        {
+            child.reset(new PageTableNode());
+            num_nodes++;
+        }
+        node = child.get();
+    }
+    return node->entries[index(vpn, 1)];
+}
+
+PageTableEntry *PageTable::find(uint64_t vpn, int &level) const
+{
+    PageTableNode *node = root.get();
+    for (level = PT_LEVELS; level > 1; level--)
+    {
+        size_t i = index(vpn, level);
+        if (node->entries[i].valid)
+            return &node->entries[i];
+        node = node->children[i].get();
+        if (!node)
+            return nullptr;
+    }
+    return &node->entries[index(vpn, 1)];
+}
+
+size_t PageTable::subtree_nodes(const PageTableNode *node, int level)
+{
+    size_t n = 1;
+    if (level > 1)
+        for (auto &child : node->children)
+            if (child)
+                n += subtree_nodes(child.get(), level - 1);
+    return n;
+}
+
+uint64_t PageTable::subtree_pages(const PageTableNode *node, int level)
+{
+    uint64_t n = 0;
+    for (size_t i = 0; i < PT_ENTRIES; i++)
+    {
+        if (node->entries[i].valid)
+            n += pages_at_level(level);
+        else if (level > 1 && node->children[i])
+            n += subtree_pages(node->children[i].get(), level - 1);
+    }
+    return n;
+}
+
+PageTableEntry &PageTable::huge_entry(uint64_t vpn, int level)
+{
+    PageTableNode *node = root.get();
+    for (int l = PT_LEVELS; l > level; l--)
+    {
+        auto &child = node->children[index(vpn, l)];
+        if (!child)
+        {
+            child.reset(new PageTableNode());
+            num_nodes++;
+        }
+        node = child.get();
+    }
+    size_t i = index(vpn, level);
+    if (node->children[i])
+    {
+        // the huge page replaces a whole table (and everything below it)
+        num_nodes -= subtree_nodes(node->children[i].get(), level - 1);
+        node->children[i].reset();
+    }
+    return node->entries[i];
+}
+
+uint64_t PageTable::mapped_pages(uint64_t vpn, int level) const
+{
+    const PageTableNode *node = root.get();
+    for (int l = PT_LEVELS; l > level; l--)
+    {
+        size_t i = index(vpn, l);
+        if (node->entries[i].valid)
+            return pages_at_level(level); // inside a bigger huge page
+        node = node->children[i].get();
+        if (!node)
+            return 0;
+    }
+    size_t i = index(vpn, level);
+    if (node->entries[i].valid)
+        return pages_at_level(level);
+    if (!node->children[i])
+        return 0;
+    return subtree_pages(node->children[i].get(), level - 1);
+}
+
+/* ---------------- CHECKPOINT ---------------- */
+
+static bool blank(const PageTableEntry &e)
+{
+    return !e.valid && e.frame == -1 && e.arrival == 0 && e.last_used == 0 && !e.ref_bit && !e.dirty && !e.cow;
+}
+
+void PageTable::save_node(CheckpointWriter &out, const PageTableNode *node, int level)
+{
+    size_t used = 0;
+    for (const auto &e : node->entries)
+        used += !blank(e);
+    out.put(used);
+    for (size_t i = 0; i < PT_ENTRIES; i++)
+    {
+        const PageTableEntry &e = node->entries[i];
+        if (blank(e))
+            continue;
+        out.put(i);
+        out.put_bool(e.valid);
+        out.put_signed(e.frame);
+        out.put(e.arrival);
+        out.put(e.last_used);
+        out.put((e.ref_bit ? 1 : 0) | (e.dirty ? 2 : 0) | (e.cow ? 4 : 0));
+    }
+    if (level == 1)
+        return;
+    size_t children = 0;
+    for (const auto &c : node->children)
+        children += c != nullptr;
+    out.put(children);
+    for (size_t i = 0; i < PT_ENTRIES; i++)
+    {
+        if (!node->children[i])
+            continue;
+        out.put(i);
+        save_node(out, node->children[i].get(), level - 1);
+    }
+}
+
+size_t PageTable::load_node(CheckpointReader &in, PageTableNode *node, int level, uint64_t frames)
+{
+    uint64_t used = in.get_below(PT_ENTRIES + 1, "page table entry count");
+    for (uint64_t n = 0; n < used; n++)
+    {
+        PageTableEntry &e = node->entries[in.get_below(PT_ENTRIES, "page table index")];
+        e.valid = in.get_bool();
+        int64_t frame = in.get_signed();
+        if (frame < -1 || frame >= (int64_t)frames)
+            throw std::runtime_error("Checkpoint holds a bad frame number");
+        e.frame = (int)frame;
+        e.arrival = in.get();
+        e.last_used = in.get();
+        uint64_t flags = in.get_below(8, "page table flags");
+        e.ref_bit = flags & 1;
+        e.dirty = flags & 2;
+        e.cow = flags & 4;
+    }
+    if (level == 1)
+        return 1;
+    size_t tables = 1;
+    uint64_t children = in.get_below(PT_ENTRIES + 1, "page table child count");
+    for (uint64_t n = 0; n < children; n++)
+    {
+        auto &child = node->children[in.get_below(PT_ENTRIES, "page table index")];
+        if (child)
+            throw std::runtime_error("Checkpoint holds a page table twice");
+        child.reset(new PageTableNode());
+        tables += load_node(in, child.get(), level - 1, frames);
+    }
+    return tables;
+}
+
+void PageTable::checkpoint(CheckpointWriter &out) const
+{
+    out.put(walks);
+    out.put(walk_levels);
+    save_node(out, root.get(), PT_LEVELS);
+}
+
+void PageTable::restore(CheckpointReader &in, uint64_t frames)
+{
+    walks = in.get();
+    walk_levels = in.get();
+    root.reset(new PageTableNode());
+    num_nodes = load_node(in, root.get(), PT_LEVELS, frames);
+}
@@ -11,3 +11,61 @@ echo "=== Buddy Allocator ==="
 
 echo "=== Virtual Memory ==="
 ./simulator < tests/test_vm.txt
+
+echo "=== TLB ==="
+./simulator < tests/test_tlb.txt
+
+echo "=== Huge Pages ==="
+./simulator < tests/test_hugepage.txt
+
+echo "=== Fork / Copy-on-write ==="
+./simulator < tests/test_fork.txt
+
+echo "=== NUMA ==="
+./simulator < tests/test_numa.txt
+
+echo "=== DRAM ==="
+./simulator < tests/test_dram.txt
+
+echo "=== Batch replay ==="
+./simulator --config tests/batch_vm.cfg --trace tests/trace_vm.txt
+
+echo "=== Binary trace ==="
+BIN=$(mktemp)
+./simulator --mode vm --trace tests/trace_vm.txt --convert "$BIN" --encoding delta > /dev/null
+./simulator --config tests/batch_vm.cfg --trace "$BIN"
+rm -f "$BIN"
+./simulator --mode alloc --set memory=65536 --set min_block=16 --trace tests/trace_alloc.txt
+
+echo "=== Workload generators ==="
+./simulator --set workload=zipf --set count=100000 --set footprint=4194304 --set seed=42
+./simulator --mode alloc --set workload=alloc --set allocator=first_fit --set lifetime=random --set count=20000
+
+echo "=== Parameter sweep ==="
+./simulator --config tests/batch_vm.cfg --trace tests/trace_vm.txt --sweep frames=2..8+2 --sweep policy=fifo,lru --threads 2 2> /dev/null
+
+echo "=== Statistics export ==="
+./simulator --mode alloc --set memory=65536 --set min_block=16 --trace tests/trace_alloc.txt --stats - --stats-every 5 | grep snapshot
+
+echo "=== Checkpoint / restore ==="
+CKPT=$(mktemp)
+./simulator --config tests/batch_vm.cfg --trace tests/trace_vm.txt --set checkpoint="$CKPT" > /dev/null
+./simulator --config tests/batch_vm.cfg --trace tests/trace_vm.txt --set restore="$CKPT"
+rm -f "$CKPT"
+
+echo "=== Allocator comparison ==="
+./simulator --mode alloc --set memory=65536 --set min_block=16 --trace tests/trace_alloc.txt --compare buddy,first_fit,best_fit,worst_fit --compare-every 5 | cut -d, -f1-12
+
+echo "=== Adaptive replacement / victim cache ==="
+# a hot window a bit larger than L1 that moves every phase: LFU keeps the old window,
+# adaptive should get back to within a few percent of LRU
+PHASED="--set workload=phased --set hot_bytes=36864 --set phase_length=20000 --set footprint=16777216 --set count=100000"
+for p in lru lfu adaptive; do
+    echo -n "$p: "
+    ./simulator $PHASED --set cache_policy=$p | grep "^L1"
+done
+# same workload on a direct-mapped L1: a victim cache takes back conflict misses
+for v in 0 16 64; do
+    echo -n "victim $v: "
+    ./simulator $PHASED --set l1_ways=1 --set l1_victim=$v | grep "^L1"
+done
@@ -28,7 +28,23 @@ g++ -std=c++17 \
     memory.cpp \
     cache.cpp \
     buddy.cpp \
+    allocator.cpp \
     virtual_memory.cpp \
+    page_table.cpp \
+    tlb.cpp \
+    backing_store.cpp \
+    concurrent_vm.cpp \
+    numa.cpp \
+    dram.cpp \
+    trace.cpp \
+    binary_trace.cpp \
+    workload.cpp \
+    sweep.cpp \
+    stats.cpp \
+    event_trace.cpp \
+    checkpoint.cpp \
+    batch.cpp \
+    -pthread \
     -o simulator
 
 echo ""
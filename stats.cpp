@@ -0,0 +1,159 @@
+#include "include/stats.h"
+#include "include/checkpoint.h"
+
+/* ---------------- HISTOGRAM ---------------- */
+
+void Histogram::clear()
+{
+    for (int b = 0; b < BUCKETS; b++)
+        counts[b] = 0;
+    total = 0;
+    sum_ = 0;
+    min_ = UINT64_MAX;
+    max_ = 0;
+}
+
+uint64_t Histogram::percentile(double p) const
+{
+    if (total == 0)
+        return 0;
+    uint64_t rank = (uint64_t)(p * (total - 1)) + 1; // 1-based
+    uint64_t seen = 0;
+    for (int b = 0; b < BUCKETS; b++) {
+        seen += counts[b];
+        if (seen >= rank)
+            return bucket_limit(b) < max_ ? bucket_limit(b) : max_;
+    }
+    return max_;
+}
+
+// non-empty buckets only
+void Histogram::checkpoint(CheckpointWriter &out) const
+{
+    out.put(total);
+    out.put(sum_);
+    out.put(min_);
+    out.put(max_);
+    int used = 0;
+    for (int b = 0; b < BUCKETS; b++)
+        used += counts[b] != 0;
+    out.put(used);
+    for (int b = 0; b < BUCKETS; b++)
+        if (counts[b]) {
+            out.put(b);
+            out.put(counts[b]);
+        }
+}
+
+void Histogram::restore(CheckpointReader &in)
+{
+    clear();
+    total = in.get();
+    sum_ = in.get();
+    min_ = in.get();
+    max_ = in.get();
+    uint64_t used = in.get_below(BUCKETS + 1, "histogram");
+    for (uint64_t i = 0; i < used; i++) {
+        int b = (int)in.get_below(BUCKETS, "histogram bucket");
+        counts[b] = in.get();
+    }
+}
+
+/* ---------------- REGISTRY ---------------- */
+
+void StatsRegistry::counter(const std::string &name, const uint64_t *value) { counters[name] = value; }
+void StatsRegistry::gauge(const std::string &name, std::function<double()> read) { gauges[name] = read; }
+void StatsRegistry::histogram(const std::string &name, const Histogram *h) { histograms[name] = h; }
+void StatsRegistry::distribution(const std::string &name, std::function<Histogram()> build) { distributions[name] = build; }
+
+static const double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+static const char *QUANTILE_NAMES[] = {"p50", "p90", "p99", "p999"};
+
+static std::string json_string(const std::string &s)
+{
+    std::string q = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            q += '\\';
+        q += c;
+    }
+    return q + "\"";
+}
+
+static void json_histogram(std::ostream &out, const Histogram &h)
+{
+    out << "{\"count\":" << h.count() << ",\"sum\":" << h.sum() << ",\"min\":" << h.min() << ",\"max\":" << h.max()
+        << ",\"mean\":" << h.mean();
+    for (int q = 0; q < 4; q++)
+        out << ",\"" << QUANTILE_NAMES[q] << "\":" << h.percentile(QUANTILES[q]);
+    // only the buckets in use, as [largest value, count]
+    out << ",\"buckets\":[";
+    bool first = true;
+    for (int b = 0; b < Histogram::BUCKETS; b++) {
+        if (!h.bucket(b))
+            continue;
+        out << (first ? "" : ",") << "[" << Histogram::bucket_limit(b) << "," << h.bucket(b) << "]";
+        first = false;
+    }
+    out << "]}";
+}
+
+void StatsRegistry::write_json(std::ostream &out)
+{
+    snapshots++;
+    out << "{\"snapshot\":" << snapshots << ",\"counters\":{";
+    const char *sep = "";
+    for (const auto &c : counters) {
+        out << sep << json_string(c.first) << ":" << *c.second;
+        sep = ",";
+    }
+    out << "},\"gauges\":{";
+    sep = "";
+    for (const auto &g : gauges) {
+        out << sep << json_string(g.first) << ":" << g.second();
+        sep = ",";
+    }
+    out << "},\"histograms\":{";
+    sep = "";
+    for (const auto &h : histograms) {
+        out << sep << json_string(h.first) << ":";
+        json_histogram(out, *h.second);
+        sep = ",";
+    }
+    for (const auto &d : distributions) {
+        out << sep << json_string(d.first) << ":";
+        json_histogram(out, d.second());
+        sep = ",";
+    }
+    out << "}}\n";
+    out.flush();
+}
+
+static void csv_histogram(std::ostream &out, uint64_t snapshot, const std::string &name, const Histogram &h)
+{
+    out << snapshot << "," << name << ".count,histogram," << h.count() << "\n";
+    out << snapshot << "," << name << ".sum,histogram," << h.sum() << "\n";
+    out << snapshot << "," << name << ".min,histogram," << h.min() << "\n";
+    out << snapshot << "," << name << ".max,histogram," << h.max() << "\n";
+    out << snapshot << "," << name << ".mean,histogram," << h.mean() << "\n";
+    for (int q = 0; q < 4; q++)
+        out << snapshot << "," << name << "." << QUANTILE_NAMES[q] << ",histogram," << h.percentile(QUANTILES[q]) << "\n";
+    for (int b = 0; b < Histogram::BUCKETS; b++)
+        if (h.bucket(b))
+            out << snapshot << "," << name << ".le_" << Histogram::bucket_limit(b) << ",bucket," << h.bucket(b) << "\n";
+}
+
+void StatsRegistry::write_csv(std::ostream &out)
+{
+    if (snapshots++ == 0)
+        out << "snapshot,metric,kind,value\n";
+    for (const auto &c : counters)
+        out << snapshots << "," << c.first << ",counter," << *c.second << "\n";
+    for (const auto &g : gauges)
+        out << snapshots << "," << g.first << ",gauge," << g.second() << "\n";
+    for (const auto &h : histograms)
+        csv_histogram(out, snapshots, h.first, *h.second);
+    for (const auto &d : distributions)
+        csv_histogram(out, snapshots, d.first, d.second());
+    out.flush();
+}
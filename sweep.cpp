@@ -0,0 +1,174 @@
+#include "include/sweep.h"
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+/* ---------------- GRID ---------------- */
+
+static uint64_t range_number(const std::string &spec, const std::string &s)
+{
+    size_t used = 0;
+    uint64_t v = 0;
+    try {
+        v = std::stoull(s, &used, 0);
+    } catch (const std::exception &) {
+        used = 0;
+    }
+    if (used == 0 || used != s.size() || s[0] == '-')
+        throw std::invalid_argument("Bad range " + spec);
+    return v;
+}
+
+// a..b, a..b*f, a..b+s
+static void expand_range(const std::string &item, size_t dots, std::vector<std::string> &out)
+{
+    std::string first = item.substr(0, dots);
+    std::string rest = item.substr(dots + 2);
+    size_t op = rest.find_first_of("*+");
+    char kind = op == std::string::npos ? '*' : rest[op];
+    uint64_t a = range_number(item, first);
+    uint64_t b = range_number(item, rest.substr(0, op));
+    uint64_t step = op == std::string::npos ? 2 : range_number(item, rest.substr(op + 1));
+    if (a > b || (kind == '*' && (a == 0 || step < 2)) || (kind == '+' && step == 0))
+        throw std::invalid_argument("Bad range " + item);
+    for (uint64_t v = a; v <= b; v = kind == '*' ? v * step : v + step) {
+        out.push_back(std::to_string(v));
+        if ((kind == '*' && v > UINT64_MAX / step) || (kind == '+' && v > UINT64_MAX - step))
+            break;
+    }
+}
+
+SweepAxis parse_axis(const std::string &spec)
+{
+    size_t eq = spec.find('=');
+    if (eq == std::string::npos || eq == 0 || eq + 1 == spec.size())
+        throw std::invalid_argument("--sweep expects key=values");
+    SweepAxis axis;
+    axis.key = spec.substr(0, eq);
+    std::string list = spec.substr(eq + 1);
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos)
+            comma = list.size();
+        std::string item = list.substr(start, comma - start);
+        if (item.empty())
+            throw std::invalid_argument("--sweep " + axis.key + ": empty value");
+        size_t dots = item.find("..");
+        if (dots != std::string::npos)
+            expand_range(item, dots, axis.values);
+        else
+            axis.values.push_back(item);
+        start = comma + 1;
+    }
+    return axis;
+}
+
+std::vector<SweepPoint> expand_grid(const BatchConfig &base, const std::vector<SweepAxis> &axes)
+{
+    std::vector<SweepPoint> grid;
+    size_t total = 1;
+    for (const SweepAxis &a : axes)
+        total *= a.values.size();
+    std::vector<size_t> index(axes.size(), 0); // odometer, last axis fastest
+    for (size_t n = 0; n < total; n++) {
+        SweepPoint p;
+        p.cfg = base;
+        for (size_t i = 0; i < axes.size(); i++) {
+            const std::string &value = axes[i].values[index[i]];
+            set_option(p.cfg, axes[i].key, value);
+            p.values.push_back(value);
+        }
+        grid.push_back(p);
+        for (size_t i = axes.size(); i-- > 0;) {
+            if (++index[i] < axes[i].values.size())
+                break;
+            index[i] = 0;
+        }
+    }
+    return grid;
+}
+
+/* ---------------- RUN ---------------- */
+
+std::vector<SweepRun> run_sweep(const std::vector<SweepPoint> &grid, const char *trace, size_t trace_size,
+                                const std::string &format, size_t threads)
+{
+    std::vector<SweepRun> runs(grid.size());
+    std::atomic<size_t> next(0);
+
+    // workers take the next point until the grid is used up
+    auto worker = [&]() {
+        for (size_t i = next++; i < grid.size(); i = next++) {
+            const BatchConfig &cfg = grid[i].cfg;
+            try {
+                std::unique_ptr<TraceSource> source;
+                if (cfg.workload != BatchWorkload::TRACE)
+                    source = make_workload(cfg);
+                else if (trace)
+                    source = open_trace(trace, trace_size, format, cfg);
+                else
+                    throw std::invalid_argument("no --trace and no workload");
+                runs[i].result = run_trace(cfg, *source);
+            } catch (const std::exception &e) {
+                runs[i].error = e.what();
+            }
+        }
+    };
+
+    if (threads == 0)
+        threads = 1;
+    threads = std::min(threads, grid.size());
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < threads; t++)
+        pool.emplace_back(worker);
+    worker(); // the calling thread is one of the workers
+    for (auto &th : pool)
+        th.join();
+    return runs;
+}
+
+/* ---------------- CSV ---------------- */
+
+static std::string csv_field(const std::string &s)
+{
+    if (s.find_first_of(",\"\n") == std::string::npos)
+        return s;
+    std::string q = "\"";
+    for (char c : s) {
+        if (c == '"')
+            q += '"';
+        q += c == '\n' ? ' ' : c;
+    }
+    return q + "\"";
+}
+
+static double ratio(uint64_t part, uint64_t whole) { return whole ? (double)part / whole : 0.0; }
+
+void write_csv(std::ostream &out, const std::vector<SweepAxis> &axes, const std::vector<SweepPoint> &grid,
+               const std::vector<SweepRun> &runs)
+{
+    for (const SweepAxis &a : axes)
+        out << csv_field(a.key) << ",";
+    out << "references,l1_hit_rate,l2_hit_rate,l3_hit_rate,ram_accesses,total_cycles,cycles_per_reference,"
+        << "page_faults,major_faults,writebacks,tlb_misses,page_walks,translation_cycles,fault_cycles,"
+        << "row_hits,row_misses,row_conflicts,dram_latency,"
+        << "allocations,alloc_failures,peak_bytes,free_bytes,largest_free,"
+        << "seconds,error\n";
+    for (size_t i = 0; i < grid.size(); i++) {
+        for (const std::string &v : grid[i].values)
+            out << csv_field(v) << ",";
+        const BatchResult &r = runs[i].result;
+        out << r.references;
+        for (int l = 0; l < 3; l++)
+            out << "," << ratio(r.cache_hits[l], r.cache_hits[l] + r.cache_misses[l]);
+        out << "," << r.ram_accesses << "," << r.total_cycles << "," << ratio(r.total_cycles, r.references)
+            << "," << r.page_faults << "," << r.major_faults << "," << r.writebacks << "," << r.tlb_misses
+            << "," << r.page_walks << "," << r.translation_cycles << "," << r.fault_cycles
+            << "," << r.row_hits << "," << r.row_misses << "," << r.row_conflicts << "," << r.dram_latency
+            << "," << r.allocations << "," << r.alloc_failures << "," << r.peak_bytes << "," << r.free_bytes
+            << "," << r.largest_free << "," << r.seconds << "," << csv_field(runs[i].error) << "\n";
+    }
+}
@@ -0,0 +1,153 @@
+#include "include/tlb.h"
+#include "include/page_table.h"
+#include "include/checkpoint.h"
+#include <stdexcept>
+#include <limits>
+
+TLB::TLB(const TlbConfig &config)
+    : num_sets(config.sets == 0 ? 1 : config.sets),
+      associativity(config.ways == 0 ? 1 : config.ways),
+      policy(config.policy),
+      hit_latency(config.hit_latency),
+      miss_latency(config.miss_latency),
+      global_time(0),
+      has_huge(false),
+      hits(0),
+      misses(0)
+{
+    sets.resize(num_sets,
+        std::vector<TlbEntry>(associativity, {false, 0, 0, 1, -1, 0, 0, 0}));
+}
+
+int TLB::find_victim(size_t set_index)
+{
+    int victim = 0;
+    uint64_t best = std::numeric_limits<uint64_t>::max();
+
+    for (int i = 0; i < (int)associativity; i++)
+    {
+        const TlbEntry &e = sets[set_index][i];
+        if (!e.valid)
+            return i;
+
+        uint64_t key = (policy == ReplacementPolicy::FIFO) ? e.arrival
+                     : (policy == ReplacementPolicy::LRU)  ? e.last_used
+                                                           : e.frequency;
+        if (key < best)
+        {
+            best = key;
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+// entries of every page size share the sets, indexed by their own page number
+TlbEntry *TLB::probe(int asid, uint64_t vpn, int level)
+{
+    uint64_t tag = vpn >> ((level - 1) * PT_INDEX_BITS);
+    for (auto &e : sets[tag % num_sets])
+        if (e.valid && e.level == level && e.vpn == tag && e.asid == asid)
+            return &e;
+    return nullptr;
+}
+
+bool TLB::lookup(int asid, uint64_t vpn, int &frame)
+{
+    global_time++;
+    int max_level = has_huge ? HUGE_1G_LEVEL : 1;
+    for (int level = 1; level <= max_level; level++)
+    {
+        TlbEntry *e = probe(asid, vpn, level);
+        if (e)
+        {
+            hits++;
+            e->last_used = global_time;
+            e->frequency++;
+            frame = e->frame + (int)(vpn & (pages_at_level(level) - 1));
+            return true;
+        }
+    }
+    misses++;
+    return false;
+}
+
+void TLB::insert(int asid, uint64_t vpn, int frame, int level)
+{
+    global_time++;
+    if (level > 1)
+        has_huge = true;
+    TlbEntry *e = probe(asid, vpn, level);
+    if (e)
+    {
+        e->frame = frame;
+        e->last_used = global_time;
+        return;
+    }
+    uint64_t tag = vpn >> ((level - 1) * PT_INDEX_BITS);
+    size_t set_index = tag % num_sets;
+    sets[set_index][find_victim(set_index)] = {true, asid, tag, level, frame, global_time, global_time, 1};
+}
+
+void TLB::invalidate(int asid, uint64_t vpn, int level)
+{
+    TlbEntry *e = probe(asid, vpn, level);
+    if (e)
+        e->valid = false;
+}
+
+void TLB::flush()
+{
+    for (auto &set : sets)
+        for (auto &e : set)
+            e.valid = false;
+}
+
+void TLB::checkpoint(CheckpointWriter &out) const
+{
+    out.put(num_sets);
+    out.put(associativity);
+    out.put(global_time);
+    out.put_bool(has_huge);
+    out.put(hits);
+    out.put(misses);
+    for (const auto &set : sets)
+        for (const TlbEntry &e : set)
+        {
+            out.put_bool(e.valid);
+            if (!e.valid)
+                continue;
+            out.put_signed(e.asid);
+            out.put(e.vpn);
+            out.put(e.level);
+            out.put_signed(e.frame);
+            out.put(e.arrival);
+            out.put(e.last_used);
+            out.put(e.frequency);
+        }
+}
+
+void TLB::restore(CheckpointReader &in)
+{
+    if (in.get() != num_sets || in.get() != associativity)
+        throw std::runtime_error("Checkpoint TLB has a different geometry");
+    global_time = in.get();
+    has_huge = in.get_bool();
+    hits = in.get();
+    misses = in.get();
+    for (auto &set : sets)
+        for (TlbEntry &e : set)
+        {
+            e = {false, 0, 0, 1, -1, 0, 0, 0};
+            if (!in.get_bool())
+                continue;
+            e.valid = true;
+            e.asid = (int)in.get_signed();
+            e.vpn = in.get();
+            e.level = (int)in.get_below(PT_LEVELS + 1, "TLB page level");
+            e.frame = (int)in.get_signed();
+            e.arrival = in.get();
+            e.last_used = in.get();
+            e.frequency = in.get();
+        }
+}
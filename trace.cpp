@@ -0,0 +1,241 @@
+#include "include/trace.h"
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TRACE_MMAP_SUPPORTED
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/* ---------------- MAPPED FILE ---------------- */
+
+MappedFile::MappedFile(const std::string &path)
+    : bytes(nullptr),
+      length(0),
+      mapping(nullptr)
+{
+#ifdef TRACE_MMAP_SUPPORTED
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        throw std::runtime_error("Cannot open " + path);
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot stat " + path);
+    }
+    length = (size_t)st.st_size;
+    if (length > 0) {
+        void *m = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Cannot map " + path);
+        }
+        madvise(m, length, MADV_SEQUENTIAL); // read once, front to back
+        mapping = m;
+        bytes = static_cast<const char *>(m);
+    }
+    close(fd); // the mapping stays valid
+#else
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("Cannot open " + path);
+    std::ostringstream buf;
+    buf << in.rdbuf();
+    contents = buf.str();
+    bytes = contents.data();
+    length = contents.size();
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef TRACE_MMAP_SUPPORTED
+    if (mapping)
+        munmap(mapping, length);
+#endif
+}
+
+/* ---------------- TEXT TRACE ---------------- */
+
+static bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+// decimal or 0x hex, nullptr if there is no number at p
+static const char *parse_number(const char *p, const char *end, uint64_t &value)
+{
+    int base = 10;
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        p += 2;
+        base = 16;
+    }
+    auto res = std::from_chars(p, end, value, base);
+    if (res.ec != std::errc())
+        return nullptr;
+    return res.ptr;
+}
+
+TextTrace::TextTrace(const char *data, size_t size, bool pids)
+    : begin(data),
+      cur(data),
+      end(data + size),
+      with_pid(pids),
+      line(0)
+{
+}
+
+bool TextTrace::next(TraceRecord &r)
+{
+    while (cur < end) {
+        const char *eol = static_cast<const char *>(memchr(cur, '\n', end - cur));
+        if (!eol)
+            eol = end;
+        const char *p = cur;
+        cur = eol < end ? eol + 1 : end;
+        line++;
+
+        const char *comment = static_cast<const char *>(memchr(p, '#', eol - p));
+        const char *stop = comment ? comment : eol;
+        while (p < stop && is_space(*p))
+            p++;
+        if (p == stop)
+            continue; // blank or comment
+        if ((stop - p > 5 && memcmp(p, "alloc", 5) == 0 && is_space(p[5])) ||
+            (stop - p > 4 && memcmp(p, "free", 4) == 0 && is_space(p[4]))) {
+            parse_allocator(p, stop, r);
+            return true;
+        }
+
+        uint64_t fields[2];
+        int count = 0;
+        bool write = false, mode = false;
+        while (true) {
+            while (p < stop && is_space(*p))
+                p++;
+            if (p == stop)
+                break;
+            const char *tok = p;
+            while (p < stop && !is_space(*p))
+                p++;
+            size_t len = p - tok;
+
+            if (count == 0 && len == 6 && memcmp(tok, "access", 6) == 0)
+                continue;
+            if (len == 1 && (*tok == 'r' || *tok == 'w') && count == (with_pid ? 2 : 1) && !mode) {
+                write = *tok == 'w';
+                mode = true;
+                continue;
+            }
+            uint64_t v;
+            if (count == 2 || mode || parse_number(tok, p, v) != p)
+                throw std::runtime_error("Trace line " + std::to_string(line) + ": expected " +
+                                         (with_pid ? "<pid> <address> [r|w]" : "<address> [r|w]"));
+            fields[count++] = v;
+        }
+        if (count == 0)
+            continue; // blank or comment
+        if (count != (with_pid ? 2 : 1))
+            throw std::runtime_error("Trace line " + std::to_string(line) + ": expected " +
+                                     (with_pid ? "<pid> <address> [r|w]" : "<address> [r|w]"));
+        r.op = write ? TraceOp::WRITE : TraceOp::READ;
+        r.pid = with_pid ? (int)fields[0] : 0;
+        r.addr = fields[count - 1];
+        r.size = 0;
+        return true;
+    }
+    return false;
+}
+
+// alloc <id> <bytes> / free <id>
+void TextTrace::parse_allocator(const char *p, const char *stop, TraceRecord &r) const
+{
+    bool alloc = *p == 'a';
+    p += alloc ? 5 : 4;
+    uint64_t fields[2];
+    int count = 0;
+    while (true) {
+        while (p < stop && is_space(*p))
+            p++;
+        if (p == stop)
+            break;
+        const char *tok = p;
+        while (p < stop && !is_space(*p))
+            p++;
+        uint64_t v;
+        if (count == (alloc ? 2 : 1) || parse_number(tok, p, v) != p) {
+            count = -1;
+            break;
+        }
+        fields[count++] = v;
+    }
+    if (count != (alloc ? 2 : 1) || (alloc && (fields[1] == 0 || fields[1] > UINT32_MAX)))
+        throw std::runtime_error("Trace line " + std::to_string(line) + ": expected " +
+                                 (alloc ? "alloc <id> <bytes>" : "free <id>"));
+    r.op = alloc ? TraceOp::ALLOC : TraceOp::FREE;
+    r.pid = 0;
+    r.addr = fields[0];
+    r.size = alloc ? (uint32_t)fields[1] : 0;
+}
+
+/* ---------------- LACKEY TRACE ---------------- */
+
+LackeyTrace::LackeyTrace(const char *data, size_t size)
+    : begin(data),
+      cur(data),
+      end(data + size),
+      pending_store(false),
+      last()
+{
+}
+
+bool LackeyTrace::next(TraceRecord &r)
+{
+    if (pending_store) {
+        // second half of a modify
+        pending_store = false;
+        r = last;
+        r.op = TraceOp::WRITE;
+        return true;
+    }
+    while (cur < end) {
+        const char *eol = static_cast<const char *>(memchr(cur, '\n', end - cur));
+        if (!eol)
+            eol = end;
+        const char *p = cur;
+        cur = eol < end ? eol + 1 : end;
+
+        // "I  addr,size" or " L addr,size", anything else is valgrind chatter
+        while (p < eol && *p == ' ')
+            p++;
+        if (eol - p < 4 || !is_space(p[1]))
+            continue;
+        char kind = *p;
+        if (kind != 'I' && kind != 'L' && kind != 'S' && kind != 'M')
+            continue;
+        p++;
+        while (p < eol && is_space(*p))
+            p++;
+        uint64_t addr, size;
+        auto a = std::from_chars(p, eol, addr, 16);
+        if (a.ec != std::errc() || a.ptr == eol || *a.ptr != ',')
+            continue;
+        auto s = std::from_chars(a.ptr + 1, eol, size, 10);
+        if (s.ec != std::errc())
+            continue;
+
+        r.op = kind == 'I' ? TraceOp::FETCH : kind == 'S' ? TraceOp::WRITE : TraceOp::READ;
+        r.pid = 0;
+        r.addr = addr;
+        r.size = (uint32_t)size;
+        if (kind == 'M') {
+            last = r;
+            pending_store = true;
+        }
+        return true;
+    }
+    return false;
+}
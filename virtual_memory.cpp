@@ -1,6 +1,121 @@
 #include "include/virtual_memory.h"
+#include "include/event_trace.h"
+#include "include/checkpoint.h"
 #include <cstring>
+#include <algorithm>
 #include <limits>
+#include <stdexcept>
+#include <iterator>
+#include <unordered_map>
+
+/* ---------------- FRAME LIST ---------------- */
+// prev == -2 marks a frame that is not on the list
+
+void FrameList::init(size_t frames)
+{
+    prev.assign(frames, -2);
+    next.assign(frames, -1);
+    head = tail = -1;
+    count = 0;
+}
+
+void FrameList::push_back(int frame)
+{
+    prev[frame] = tail;
+    next[frame] = -1;
+    if (tail != -1)
+        next[tail] = frame;
+    else
+        head = frame;
+    tail = frame;
+    count++;
+}
+
+void FrameList::push_front(int frame)
+{
+    prev[frame] = -1;
+    next[frame] = head;
+    if (head != -1)
+        prev[head] = frame;
+    else
+        tail = frame;
+    head = frame;
+    count++;
+}
+
+void FrameList::remove(int frame)
+{
+    if (prev[frame] != -1)
+        next[prev[frame]] = next[frame];
+    else
+        head = next[frame];
+    if (next[frame] != -1)
+        prev[next[frame]] = prev[frame];
+    else
+        tail = prev[frame];
+    prev[frame] = -2;
+    next[frame] = -1;
+    count--;
+}
+
+void FrameList::replace(int frame, int with)
+{
+    prev[with] = prev[frame];
+    next[with] = next[frame];
+    if (prev[frame] != -1)
+        next[prev[frame]] = with;
+    else
+        head = with;
+    if (next[frame] != -1)
+        prev[next[frame]] = with;
+    else
+        tail = with;
+    prev[frame] = -2;
+    next[frame] = -1;
+}
+
+void ProcessFrames::push_back(int frame)
+{
+    links[frame] = {tail, -1};
+    if (tail != -1)
+        links[tail].next = frame;
+    else
+        head = frame;
+    tail = frame;
+    count++;
+}
+
+void ProcessFrames::remove(int frame)
+{
+    auto it = links.find(frame);
+    Link l = it->second;
+    links.erase(it);
+    if (l.prev != -1)
+        links[l.prev].next = l.next;
+    else
+        head = l.next;
+    if (l.next != -1)
+        links[l.next].prev = l.prev;
+    else
+        tail = l.prev;
+    count--;
+}
+
+void ProcessFrames::replace(int frame, int with)
+{
+    auto it = links.find(frame);
+    Link l = it->second;
+    links.erase(it);
+    links[with] = l;
+    if (l.prev != -1)
+        links[l.prev].next = with;
+    else
+        head = with;
+    if (l.next != -1)
+        links[l.next].prev = with;
+    else
+        tail = with;
+}
 
 //constructor
 
@@ -10,131 +125,1566 @@ VirtualMemory::VirtualMemory(size_t num_pages,
                              PageReplacement pol)
     : page_size(psize),
       num_frames(frames),
-      policy(pol),
       time(0),
+      policy(pol),
+      swap(psize),
+      swap_device({25000, 1.0}),
+      clock_hand(0),
+      tlb_asid(false),
+      walk_latency(0),
+      last_pid(-1),
       page_hits(0),
       page_faults(0),
-      clock_hand(0)
+      translation_cycles(0),
+      page_walks(0),
+      walk_cycles(0),
+      tlb_flushes(0),
+      fault_cycles(0),
+      major_faults(0),
+      writebacks(0),
+      clean_evictions(0),
+      readahead_pages(0),
+      readahead_hits(0),
+      readahead_wasted(0),
+      readahead_saved_cycles(0),
+      huge_faults(0),
+      huge_fallbacks(0),
+      thp_promotions(0),
+      thp_failures(0),
+      cow_faults(0),
+      cow_copies(0),
+      shared_faults(0),
+      numa_fallbacks(0),
+      numa_migrations(0),
+      numa_migration_failures(0)
 {
-    frame_table.resize(num_frames, {-1, -1}); // {process id , page number}
-    physical_memory.resize(num_frames, std::vector<uint8_t>(page_size)); // just representational
-    disk.resize(num_pages, std::vector<uint8_t>(page_size)); // just representational
+    frame_table.resize(num_frames);
+    free_list.init(num_frames);
+    for (size_t i = 0; i < num_frames; i++) {
+        frame_table[i] = {-1, 0, 1, (int)i}; // {process id , page number, level, head}
+        free_list.push_back((int)i); // lowest frame on top, handed out first
+    }
+    free_in_block.assign(num_frames / pages_at_level(HUGE_2M_LEVEL), (uint32_t)pages_at_level(HUGE_2M_LEVEL));
+    pinned.assign(num_frames, 0);
+    frame_refs.assign(num_frames, 0);
+    cow_copy_cycles = 2000; // protection fault plus a page copy
+    thp = false;
+    migrate_threshold = 0;
+    migrate_cycles = 2000; // unmap, copy and TLB shootdown
+    scope = ReplacementScope::GLOBAL;
+    resident.init(num_frames);
+    age.assign(num_frames, 0);
+    aging_interval = 8;
+    ws_tau = 4 * num_frames;
+    opt_position = 0;
+    current_next_use = OPT_NEVER;
+    resident_next_use.assign(num_frames, OPT_UNSET);
+    readahead_min = readahead_max = readahead_window = 0;
+    prefetched.assign(num_frames, Prefetch::NONE);
+    physical_memory.resize(num_frames); // just representational, filled in lazily
+    (void)num_pages; // swap slots are created on first page out
 }
 
 // this is used to create a process
-void VirtualMemory::create_process(int pid, size_t num_pages)
+void VirtualMemory::create_process(int pid, uint64_t num_pages)
 {
-    page_tables[pid] = std::vector<PageTableEntry>(num_pages, {false, -1, 0, 0, false});
+    if (pid < 0 || pid > VM_MAX_PID)
+        throw std::out_of_range("Invalid PID (0 to " + std::to_string(VM_MAX_PID) + ")");
+    if (num_pages > PT_MAX_PAGES)
+        throw std::out_of_range("Address space larger than the page table can map");
+    if ((size_t)pid >= processes.size())
+        processes.resize(pid + 1); // flat pid -> process lookup
+    int node = numa ? pid % (int)numa->nodes() : 0;
+    processes[pid].reset(new Process{num_pages, PageTable(), UINT64_MAX, {}, {}, ProcessFrames(), 0, 0, 1, 0, 0, 0,
+                                     node, NumaPolicy::LOCAL, node, node, 0, 0});
 }
 
-int VirtualMemory::find_victim_frame()
+void VirtualMemory::configure_tlb(const TlbConfig &l1, const TlbConfig &l2, bool asid, uint64_t wlat)
 {
-    if (policy == PageReplacement::FIFO) {
-        uint64_t oldest = UINT64_MAX;
-        int victim = -1;
+    l1_tlb.reset(new TLB(l1));
+    l2_tlb.reset(new TLB(l2));
+    tlb_asid = asid;
+    walk_latency = wlat;
+}
 
-        for (int i = 0; i < (int)num_frames; i++) {
-            auto &f = frame_table[i];
-            if (f.pid != -1) {
-                auto &pte = page_tables[f.pid][f.vpn];
-                if (pte.arrival < oldest) { // checks on arrival
-                    oldest = pte.arrival; 
-                    victim = i;
-                }
-            }
+void VirtualMemory::disable_tlb()
+{
+    l1_tlb.reset();
+    l2_tlb.reset();
+}
+
+void VirtualMemory::tlb_fill(int pid, uint64_t vpn, int frame, int level)
+{
+    if (!l1_tlb)
+        return;
+    l2_tlb->insert(tlb_asid_of(pid), vpn, frame, level);
+    l1_tlb->insert(tlb_asid_of(pid), vpn, frame, level);
+}
+
+void VirtualMemory::tlb_shootdown(int pid, uint64_t vpn, int level)
+{
+    if (!l1_tlb)
+        return;
+    // without ASIDs the TLB only holds translations of the last process
+    if (!tlb_asid && pid != last_pid)
+        return;
+    l1_tlb->invalidate(tlb_asid_of(pid), vpn, level);
+    l2_tlb->invalidate(tlb_asid_of(pid), vpn, level);
+}
+
+// a shared frame keeps its replacement state in the pte of its first mapper
+PageTableEntry &VirtualMemory::frame_pte(int frame)
+{
+    if (is_shared(frame)) {
+        auto &first = sharers[frame].front();
+        return *processes[first.pid]->page_table.find(first.vpn);
+    }
+    auto &f = frame_table[frame];
+    return *processes[f.pid]->page_table.find(f.vpn);
+}
+
+size_t VirtualMemory::page_table_nodes() const
+{
+    size_t n = 0;
+    for (auto &p : processes)
+        if (p)
+            n += p->page_table.nodes();
+    return n;
+}
+
+size_t VirtualMemory::page_table_bytes() const
+{
+    size_t n = 0;
+    for (auto &p : processes)
+        if (p)
+            n += p->page_table.memory_bytes();
+    return n;
+}
+
+size_t VirtualMemory::page_table_host_bytes() const
+{
+    size_t n = 0;
+    for (auto &p : processes)
+        if (p)
+            n += p->page_table.host_bytes();
+    return n;
+}
+
+double VirtualMemory::average_walk_depth() const
+{
+    uint64_t walks = 0, levels = 0;
+    for (auto &p : processes)
+        if (p)
+        {
+            walks += p->page_table.walks;
+            levels += p->page_table.walk_levels;
         }
-        return victim;
+    return walks == 0 ? 0.0 : (double)levels / walks;
+}
+
+void VirtualMemory::referenced(int pid, PageTableEntry &pte, int frame, bool write)
+{
+    pte.last_used = time;
+    pte.ref_bit = true;
+    pte.dirty |= write;
+    if (is_shared(frame)) {
+        auto &first = frame_pte(frame);
+        first.last_used = time;
+        first.ref_bit = true;
     }
+    touch_frame(pid, frame);
+}
 
+void VirtualMemory::touch_frame(int pid, int frame)
+{
+    if (prefetched[frame] != Prefetch::NONE) {
+        // readahead paid off: this would have been a fault
+        readahead_hits++;
+        if (prefetched[frame] == Prefetch::SWAPPED)
+            readahead_saved_cycles += (int64_t)transfer_cycles(1);
+        prefetched[frame] = Prefetch::NONE;
+        readahead_window = std::min(readahead_max, readahead_window * 2);
+    }
     if (policy == PageReplacement::LRU) {
-        uint64_t least = UINT64_MAX;
-        int victim = -1;
+        resident.move_to_back(frame); // most recently used at the tail
+        processes[pid]->frames.move_to_back(frame);
+    }
+    else if (policy == PageReplacement::OPT)
+        set_next_use(frame, current_next_use);
+}
 
-        for (int i = 0; i < (int)num_frames; i++) {
-            auto &f = frame_table[i];
-            if (f.pid != -1) {
-                auto &pte = page_tables[f.pid][f.vpn];
-                if (pte.last_used < least) { // checks when was it last used
-                    least = pte.last_used;
-                    victim = i;
-                }
-            }
+/* ---------------- OPT ---------------- */
+// next_use[i] = position of the next reference to the same page after i
+static std::vector<uint64_t> next_uses(const std::vector<SwapKey> &refs)
+{
+    std::vector<uint64_t> next(refs.size(), OPT_NEVER);
+    std::unordered_map<SwapKey, uint64_t, SwapKeyHash> seen;
+    seen.reserve(refs.size());
+    for (size_t i = refs.size(); i-- > 0;)
+    {
+        auto it = seen.find(refs[i]);
+        if (it != seen.end())
+        {
+            next[i] = it->second;
+            it->second = i;
+        }
+        else
+        {
+            seen.emplace(refs[i], i);
+        }
+    }
+    return next;
+}
+
+uint64_t opt_page_faults(const std::vector<SwapKey> &refs, size_t frames)
+{
+    if (frames == 0)
+        return refs.size();
+    std::vector<uint64_t> next = next_uses(refs);
+
+    // resident pages as (next use, position of their last reference); a page is
+    // resident at reference i exactly when some entry is waiting for position i
+    std::set<std::pair<uint64_t, size_t>> order;
+    uint64_t faults = 0;
+
+    for (size_t i = 0; i < refs.size(); i++)
+    {
+        auto it = order.lower_bound({i, 0});
+        if (it != order.end() && it->first == i)
+        {
+            order.erase(it); // hit
+        }
+        else
+        {
+            faults++;
+            if (order.size() == frames)
+                order.erase(std::prev(order.end())); // farthest next use
         }
+        order.insert({next[i], i});
+    }
+    return faults;
+}
+
+void VirtualMemory::set_future(const std::vector<SwapKey> &refs)
+{
+    future_next_use = next_uses(refs);
+    opt_position = 0;
+}
+
+void VirtualMemory::set_next_use(int frame, uint64_t next)
+{
+    if (resident_next_use[frame] != OPT_UNSET)
+        opt_order.erase({resident_next_use[frame], frame});
+    resident_next_use[frame] = next;
+    opt_order.insert({next, frame});
+}
+
+/* ---------------- AGING ---------------- */
+// every aging_interval references each counter is shifted right and the
+// reference bit enters at the top, so recent use dominates the value
+void VirtualMemory::aging_tick()
+{
+    for (int f = resident.head; f != -1; f = resident.next[f])
+    {
+        auto &pte = frame_pte(f);
+        age[f] = (uint8_t)((age[f] >> 1) | (pte.ref_bit ? 0x80 : 0));
+        pte.ref_bit = false;
+    }
+}
+
+void VirtualMemory::set_aging_interval(uint64_t refs)
+{
+    aging_interval = refs == 0 ? 1 : refs;
+}
+
+int VirtualMemory::find_victim_frame(int pid)
+{
+    // local replacement looks at the per-process list, which keeps the same order
+    const ProcessFrames *own = pid == -1 ? nullptr : &processes[pid]->frames;
+    auto first = [&]() { return own ? own->head : resident.head; };
+    auto after = [&](int f) { return own ? own->after(f) : resident.next[f]; };
+
+    // FIFO keeps frames in arrival order, LRU in recency order: the head is the victim
+    if (policy == PageReplacement::FIFO || policy == PageReplacement::LRU) {
+        int f = first();
+        while (f != -1 && pinned[f])
+            f = after(f);
+        return f;
+    }
+
+    // OPT: the page whose next use is farthest away
+    if (policy == PageReplacement::OPT) {
+        for (auto it = opt_order.rbegin(); it != opt_order.rend(); ++it)
+            if (!pinned[it->second] && (!own || own->contains(it->second)))
+                return it->second;
+        return -1;
+    }
+
+    // AGING: smallest counter, oldest arrival on ties (resident is in arrival order)
+    if (policy == PageReplacement::AGING) {
+        int victim = -1;
+        for (int f = first(); f != -1; f = after(f))
+            if (!pinned[f] && (victim == -1 || age[f] < age[victim]))
+                victim = f;
         return victim;
     }
 
-    // CLOCK
-    while (true) {
-        auto &f = frame_table[clock_hand];
-        if (f.pid != -1) {
-            auto &pte = page_tables[f.pid][f.vpn];
-            if (!pte.ref_bit) {
-                int victim = clock_hand;
-                clock_hand = (clock_hand + 1) % num_frames;
-                return victim;
+    // the clocks sweep over frames, a huge page is only looked at through its first frame
+    auto skip = [&](int f) {
+        return frame_table[f].pid == -1 || frame_table[f].head != f || pinned[f] ||
+               (own && !own->contains(f));
+    };
+
+    // WSCLOCK: first clean unreferenced page that left the working set (older than tau),
+    // after a full turn the oldest unreferenced page seen
+    if (policy == PageReplacement::WSCLOCK) {
+        int fallback = -1;
+        uint64_t oldest = UINT64_MAX;
+        for (size_t step = 0; step < 2 * num_frames; step++) {
+            int f = (int)clock_hand;
+            clock_hand = (clock_hand + 1) % num_frames;
+            if (skip(f))
+                continue;
+            auto &pte = frame_pte(f);
+            if (pte.ref_bit) {
+                pte.ref_bit = false; // still in the working set
+                pte.last_used = time;
+                continue;
+            }
+            if (time - pte.last_used > ws_tau) {
+                if (!pte.dirty)
+                    return f;
+                // old but dirty: schedule the write back and keep looking for a clean page
+                if (!is_shared(f)) {
+                    page_out(frame_table[f].pid, frame_table[f].vpn, f, pages_at_level(frame_table[f].level));
+                    pte.dirty = false;
+                }
+                continue;
+            }
+            if (pte.last_used < oldest) {
+                oldest = pte.last_used;
+                fallback = f;
             }
-            pte.ref_bit = false;
         }
+        if (fallback != -1)
+            return fallback;
+        for (int f = first(); f != -1; f = after(f))
+            if (!pinned[f])
+                return f;
+        return -1;
+    }
+
+    // CLOCK: two turns clear every reference bit, so only pinned frames can stop it
+    for (size_t step = 0; step <= 2 * num_frames; step++) {
+        int f = (int)clock_hand;
         clock_hand = (clock_hand + 1) % num_frames;
+        if (skip(f))
+            continue;
+        auto &pte = frame_pte(f);
+        if (!pte.ref_bit)
+            return f;
+        pte.ref_bit = false;
     }
+    return -1;
 }
 
-void VirtualMemory::page_out(int pid, int vpn, int frame)
+/* ---------------- FRAME ALLOCATION ---------------- */
+// free frames form a stack, or come from a BuddyAllocator over frame numbers;
+// free_in_block tracks how full each aligned 512 frame block is so huge page
+// runs can be chosen without a scan of the frame table
+
+void VirtualMemory::claim_frame(int frame)
 {
-    std::memcpy(disk[vpn].data(),physical_memory[frame].data(),page_size);
+    if (!buddy)
+        free_list.remove(frame);
+    if (numa)
+        node_free[numa->node_of(frame)].remove(frame);
+    size_t block = frame / pages_at_level(HUGE_2M_LEVEL);
+    if (block < free_in_block.size())
+        free_in_block[block]--;
 }
 
-void VirtualMemory::page_in(int pid, int vpn, int frame)
+void VirtualMemory::release_frame(int frame)
 {
-    std::memcpy(physical_memory[frame].data(),disk[vpn].data(),page_size);
+    frame_table[frame] = {-1, 0, 1, frame};
+    frame_refs[frame] = 0;
+    if (!buddy)
+        free_list.push_front(frame);
+    if (numa) {
+        node_free[numa->node_of(frame)].push_front(frame);
+        remote_streak[frame] = 0;
+    }
+    size_t block = frame / pages_at_level(HUGE_2M_LEVEL);
+    if (block < free_in_block.size())
+        free_in_block[block]++;
 }
 
-uint64_t VirtualMemory::translate(int pid, uint64_t va) // proces id , virtual memory 
+// at its quota a process pays with its own pages, even with free frames around
+bool VirtualMemory::fit_quota(int pid, int keep)
 {
-    time++;
+    Process &proc = *processes[pid];
+    while (proc.quota != 0 && proc.resident_pages >= proc.quota) {
+        int victim = find_victim_frame(pid);
+        if (victim == -1 || victim == keep)
+            return false;
+        evict_frame(victim);
+    }
+    return true;
+}
 
-    auto &ptable = page_tables[pid]; // page table for a process
-    size_t vpn = va / page_size; 
-    size_t offset = va % page_size;
-    auto &pte = ptable[vpn]; // this is page table entry of the chosen page id
+int VirtualMemory::allocate_frame(int pid, int keep)
+{
+    if (!fit_quota(pid, keep))
+        return -1;
+    Process &proc = *processes[pid];
+    if (!has_free_frame()) {
+        int victim = scope == ReplacementScope::LOCAL ? find_victim_frame(pid) : -1;
+        if (victim == -1)
+            victim = find_victim_frame(); // O(1) for FIFO / LRU / OPT, the clocks sweep from the hand
+        if (victim == -1 || victim == keep)
+            return -1;
+        evict_frame(victim); // its frames go back on top of the stack
+    }
+    int frame = buddy  ? (int)buddy->allocate(1)
+              : numa   ? numa_frame(proc)
+                       : free_list.head; // any empty frame
+    claim_frame(frame);
+    return frame;
+}
 
-    // PAGE HIT
-    if (pte.valid) {
-        page_hits++;
-        pte.last_used = time;
-        pte.ref_bit = true;
-        return (uint64_t)pte.frame * page_size + offset;
+uint64_t VirtualMemory::used_frames(uint64_t first, uint64_t frames) const
+{
+    const uint64_t block = pages_at_level(HUGE_2M_LEVEL);
+    uint64_t used = 0;
+    if (frames % block == 0) {
+        for (uint64_t b = first / block; b < (first + frames) / block; b++)
+            used += block - free_in_block[b];
+    } else {
+        for (uint64_t f = first; f < first + frames; f++)
+            used += frame_table[f].pid != -1;
     }
+    return used;
+}
 
-    // PAGE FAULT
-    page_faults++;
+// aligned run of n frames (a power of two): a completely free run if there
+// is one, otherwise the unpinned run with the fewest used frames is cleared
+int VirtualMemory::allocate_run(uint64_t n)
+{
+    size_t order = 0;
+    while ((uint64_t(1) << order) < n)
+        order++;
+    if (order_stats.size() <= order)
+        order_stats.resize(order + 1, {0, 0, 0, 0, 0});
+    OrderStats &stats = order_stats[order];
+    stats.requests++;
+
+    if (buddy && buddy->largest_free_block() >= n) {
+        stats.from_free++;
+        int first = (int)buddy->allocate(n);
+        for (int f = first; f < first + (int)n; f++)
+            claim_frame(f);
+        return first;
+    }
 
-    int frame = -1;
-    for (int i = 0; i < (int)num_frames; i++) {
-        if (frame_table[i].pid == -1) {
-            frame = i; // checks if any frame is empty
-            break;
+    int best = -1;
+    uint64_t best_used = UINT64_MAX;
+    for (size_t r = 0; r < num_frames / n && best_used > 0; r++) {
+        uint64_t used = used_frames(r * n, n);
+        if (used >= best_used)
+            continue;
+        bool movable = true;
+        for (uint64_t f = r * n; f < (r + 1) * n && used > 0 && movable; f++)
+            if (frame_table[f].pid != -1 && pinned[frame_table[f].head])
+                movable = false;
+        if (movable) {
+            best = (int)r;
+            best_used = used;
         }
     }
+    if (best == -1) {
+        stats.failures++; // fragmented by pinned / DMA frames, or bigger than memory
+        if (stats.first_failure == 0)
+            stats.first_failure = time;
+        return -1;
+    }
 
-    // Eviction needed
-    if (frame == -1) {
-        frame = find_victim_frame(); // for finding victim we just iterate over all the frames and evict according to the policy
-        auto &victim = frame_table[frame];
-        auto &vpte = page_tables[victim.pid][victim.vpn];
-        page_out(victim.pid, victim.vpn, frame);
+    int first = (int)(best * n);
+    if (best_used == 0) {
+        stats.from_free++;
+    } else {
+        stats.reclaimed++;
+        for (int f = first; f < first + (int)n; f++)
+            if (frame_table[f].pid != -1)
+                evict_frame(frame_table[f].head);
+    }
+    if (buddy)
+        first = (int)buddy->allocate(n); // the cleared run has coalesced into a free block
+    for (int f = first; f < first + (int)n; f++)
+        claim_frame(f);
+    return first;
+}
+
+void VirtualMemory::use_buddy()
+{
+    if (buddy)
+        return;
+    if (numa)
+        throw std::runtime_error("NUMA nodes keep their own free stacks, the buddy allocator is not used");
+    if (free_list.count != num_frames)
+        throw std::runtime_error("Frame allocator must be chosen before any page is mapped");
+    buddy.reset(new BuddyAllocator(num_frames, 1));
+    free_list.init(num_frames);
+}
+
+int VirtualMemory::dma_alloc(uint64_t frames)
+{
+    if (!buddy)
+        throw std::runtime_error("DMA allocations need the buddy frame allocator");
+    if (frames == 0)
+        throw std::invalid_argument("DMA allocation of zero frames");
+    uint64_t n = 1;
+    while (n < frames)
+        n <<= 1;
+    int first = allocate_run(n);
+    if (first == -1)
+        return -1;
+    for (int f = first; f < first + (int)n; f++) {
+        frame_table[f] = {DMA_OWNER, 0, 1, first};
+        pinned[f] = 1;
+    }
+    dma_blocks[first] = n;
+    return first;
+}
+
+void VirtualMemory::dma_free(int first)
+{
+    auto it = dma_blocks.find(first);
+    if (it == dma_blocks.end())
+        throw std::invalid_argument("Not the first frame of a DMA allocation");
+    for (uint64_t i = it->second; i-- > 0;) {
+        pinned[first + i] = 0;
+        release_frame(first + (int)i);
+    }
+    buddy->deallocate(first);
+    dma_blocks.erase(it);
+}
+
+void VirtualMemory::evict_frame(int frame)
+{
+    FrameInfo victim = frame_table[frame];
+    uint64_t pages = pages_at_level(victim.level);
+    SIM_EVENT(PAGE_EVICT, 0, victim.vpn, victim.pid);
+    if (is_shared(frame)) {
+        unmap_shared(frame);
+    } else {
+        auto &vpte = frame_pte(frame);
+        if (vpte.dirty)
+            page_out(victim.pid, victim.vpn, frame, pages);
+        else
+            clean_evictions++; // swap copy (or zero page) is still current
         vpte.valid = false;
+        vpte.dirty = false;
+        tlb_shootdown(victim.pid, victim.vpn, victim.level);
+        processes[victim.pid]->frames.remove(frame);
+        processes[victim.pid]->resident_pages -= pages;
+    }
+
+    if (prefetched[frame] != Prefetch::NONE) {
+        // readahead guessed wrong, shrink the window
+        readahead_wasted++;
+        prefetched[frame] = Prefetch::NONE;
+        readahead_window = std::max(readahead_min, readahead_window / 2);
     }
 
-    page_in(pid, vpn, frame);
+    resident.remove(frame);
+    if (resident_next_use[frame] != OPT_UNSET) {
+        opt_order.erase({resident_next_use[frame], frame});
+        resident_next_use[frame] = OPT_UNSET;
+    }
+    // last frame first so the first one ends up on top of the free stack
+    for (uint64_t i = pages; i-- > 0;)
+        release_frame(frame + (int)i);
+    if (buddy)
+        buddy->deallocate(frame); // the mapping was allocated as one block
+}
 
+void VirtualMemory::map_frame(int pid, uint64_t vpn, PageTableEntry &pte, int frame, bool prefetch, int level)
+{
+    bool from_swap = page_in(pid, vpn, frame, pages_at_level(level), prefetch);
+    if (prefetch) {
+        prefetched[frame] = from_swap ? Prefetch::SWAPPED : Prefetch::ZERO_FILL;
+        if (from_swap)
+            readahead_saved_cycles -= (int64_t)(transfer_cycles(1) - swap_device.latency);
+    }
+    install(pid, vpn, pte, frame, level);
+}
+
+void VirtualMemory::install(int pid, uint64_t vpn, PageTableEntry &pte, int frame, int level)
+{
     pte.valid = true;
     pte.frame = frame;
     pte.arrival = time;
     pte.last_used = time;
     pte.ref_bit = true;
+    pte.cow = false;
+
+    uint64_t pages = pages_at_level(level);
+    for (uint64_t i = 0; i < pages; i++) {
+        frame_table[frame + i] = {pid, vpn + i, level, frame};
+        frame_refs[frame + i] = 1;
+    }
+    // replacement state lives on the first frame only
+    resident.push_back(frame);
+    processes[pid]->frames.push_back(frame);
+    processes[pid]->resident_pages += pages;
+    age[frame] = 0x80; // just referenced
+    if (policy == PageReplacement::OPT)
+        set_next_use(frame, current_next_use);
+}
+
+uint64_t VirtualMemory::transfer_cycles(uint64_t pages) const
+{
+    return swap_device.latency + (uint64_t)(pages * page_size / swap_device.bytes_per_cycle);
+}
+
+// a huge page goes out as one request
+void VirtualMemory::page_out(int pid, uint64_t vpn, int frame, uint64_t pages)
+{
+    for (uint64_t i = 0; i < pages; i++)
+        swap.write(pid, vpn + i, physical_memory[frame + i].data());
+    writebacks += pages;
+    fault_cycles += transfer_cycles(pages);
+}
+
+bool VirtualMemory::page_in(int pid, uint64_t vpn, int frame, uint64_t pages, bool batched)
+{
+    uint64_t read = 0;
+    for (uint64_t i = 0; i < pages; i++) {
+        auto &data = physical_memory[frame + i];
+        if (data.empty())
+            data.resize(page_size);
+        if (swap.read(pid, vpn + i, data.data()))
+            read++;
+    }
+    // never written out: zero filled without touching the device
+    if (read == 0)
+        return false;
+    if (batched) {
+        fault_cycles += transfer_cycles(read) - swap_device.latency; // rides on the demand request
+    } else {
+        major_faults++;
+        fault_cycles += transfer_cycles(read);
+    }
+    return true;
+}
+
+/* ---------------- NUMA ---------------- */
+// every node has its own free stack (free_list still holds all free frames);
+// a policy picks the node of a new page and falls back to the nearest node
+// with a free frame, so eviction only starts once every node is full
+
+void VirtualMemory::use_numa(size_t nodes, uint64_t local_latency, uint64_t remote_latency)
+{
+    if (buddy)
+        throw std::runtime_error("NUMA nodes keep their own free stacks, the buddy allocator is not used");
+    if (free_list.count != num_frames)
+        throw std::runtime_error("NUMA nodes must be set up before any page is mapped");
+    numa.reset(new NumaTopology(nodes, num_frames, local_latency, remote_latency));
+    node_free.assign(nodes, FrameList());
+    for (auto &list : node_free)
+        list.init(num_frames);
+    for (size_t i = 0; i < num_frames; i++)
+        node_free[numa->node_of((int)i)].push_back((int)i); // lowest frame of each node on top
+    remote_streak.assign(num_frames, 0);
+    node_fallback.clear();
+    for (size_t n = 0; n < nodes; n++)
+        node_fallback.push_back(numa->fallback_order((int)n));
+
+    for (size_t pid = 0; pid < processes.size(); pid++) {
+        if (!processes[pid])
+            continue;
+        Process &p = *processes[pid];
+        p.home_node = p.preferred_node = p.interleave_next = (int)(pid % nodes);
+        p.numa_policy = NumaPolicy::LOCAL;
+    }
+}
+
+void VirtualMemory::set_numa_latency(int cpu_node, int memory_node, uint64_t cycles)
+{
+    if (!numa)
+        throw std::runtime_error("NUMA is not set up");
+    numa->set_latency(cpu_node, memory_node, cycles);
+    node_fallback[cpu_node] = numa->fallback_order(cpu_node);
+}
+
+void VirtualMemory::set_home_node(int pid, int node)
+{
+    if (!numa)
+        throw std::runtime_error("NUMA is not set up");
+    if (!process(pid))
+        throw std::out_of_range("Invalid PID");
+    if (node < 0 || (size_t)node >= numa->nodes())
+        throw std::out_of_range("Invalid NUMA node");
+    processes[pid]->home_node = node;
+}
+
+void VirtualMemory::set_numa_policy(int pid, NumaPolicy p, int node)
+{
+    if (!numa)
+        throw std::runtime_error("NUMA is not set up");
+    if (!process(pid))
+        throw std::out_of_range("Invalid PID");
+    if (node < 0 || (size_t)node >= numa->nodes())
+        throw std::out_of_range("Invalid NUMA node");
+    processes[pid]->numa_policy = p;
+    if (p == NumaPolicy::PREFERRED)
+        processes[pid]->preferred_node = node;
+}
+
+void VirtualMemory::set_numa_migration(uint64_t refs, uint64_t cycles_per_page)
+{
+    migrate_threshold = refs;
+    migrate_cycles = cycles_per_page;
+}
+
+uint64_t VirtualMemory::memory_latency(int pid, uint64_t pa) const
+{
+    return numa->latency(processes[pid]->home_node, numa->node_of((int)(pa / page_size)));
+}
+
+int VirtualMemory::numa_frame(Process &proc)
+{
+    int want = proc.home_node;
+    if (proc.numa_policy == NumaPolicy::PREFERRED) {
+        want = proc.preferred_node;
+    } else if (proc.numa_policy == NumaPolicy::INTERLEAVE) {
+        want = proc.interleave_next;
+        proc.interleave_next = (want + 1) % (int)numa->nodes();
+    }
+    for (int node : node_fallback[want]) {
+        if (node_free[node].head == -1)
+            continue;
+        if (node != want)
+            numa_fallbacks++;
+        return node_free[node].head;
+    }
+    return -1; // callers make sure some frame is free
+}
+
+// automatic NUMA balancing, simplified: a private base page that its process keeps
+// referencing from another node is copied into a free frame of that process' node
+int VirtualMemory::numa_reference(int pid, Process &proc, uint64_t vpn, int frame)
+{
+    if (numa->node_of(frame) == proc.home_node) {
+        proc.local_refs++;
+        remote_streak[frame] = 0;
+        return frame;
+    }
+    proc.remote_refs++;
+    if (migrate_threshold == 0 || policy == PageReplacement::OPT || frame_table[frame].level != 1 ||
+        is_shared(frame) || pinned[frame])
+        return frame;
+    if (++remote_streak[frame] < migrate_threshold)
+        return frame;
+    remote_streak[frame] = 0;
+    int target = node_free[proc.home_node].head;
+    if (target == -1) {
+        numa_migration_failures++; // no reclaim for this, retried after the next streak
+        return frame;
+    }
+
+    auto &pte = *proc.page_table.find(vpn);
+    claim_frame(target);
+    physical_memory[target].swap(physical_memory[frame]);
+    frame_table[target] = {pid, vpn, 1, target};
+    frame_refs[target] = frame_refs[frame];
+    age[target] = age[frame];
+    prefetched[target] = prefetched[frame];
+    prefetched[frame] = Prefetch::NONE;
+    resident.replace(frame, target); // keeps its FIFO / LRU position
+    proc.frames.replace(frame, target);
+    pte.frame = target;
+    tlb_shootdown(pid, vpn, 1);
+    release_frame(frame);
+    numa_migrations++;
+    fault_cycles += migrate_cycles;
+    return target;
+}
+
+/* ---------------- HUGE PAGES ---------------- */
+void VirtualMemory::map_huge(int pid, uint64_t va, uint64_t length, int level)
+{
+    if (pid < 0 || (size_t)pid >= processes.size() || !processes[pid])
+        throw std::out_of_range("Invalid PID");
+    if (level != HUGE_2M_LEVEL && level != HUGE_1G_LEVEL)
+        throw std::invalid_argument("Huge page level must be 2 or 3");
+    Process &proc = *processes[pid];
+    if (length == 0 || va / page_size >= proc.num_pages)
+        throw std::out_of_range("Virtual range outside the process address space");
+
+    // rounded out to whole huge pages
+    uint64_t n = pages_at_level(level);
+    uint64_t first = (va / page_size) & ~(n - 1);
+    uint64_t end = ((va + length - 1) / page_size + n) & ~(n - 1);
+    proc.huge_regions.push_back({first, std::min(end, proc.num_pages), level});
+}
+
+int VirtualMemory::huge_level(const Process &proc, uint64_t vpn) const
+{
+    for (auto &r : proc.huge_regions)
+        if (vpn >= r.first_vpn && vpn < r.end_vpn)
+            return r.level;
+    return 1;
+}
+
+// fault of vpn served with a whole huge page, only if nothing in its range is mapped yet
+int VirtualMemory::map_huge_page(int pid, Process &proc, uint64_t vpn, int level, bool write)
+{
+    uint64_t n = pages_at_level(level);
+    uint64_t base = vpn & ~(n - 1);
+    if (base + n > proc.num_pages || proc.page_table.mapped_pages(base, level) != 0)
+        return -1;
+    if (proc.quota != 0 && proc.resident_pages + n > proc.quota)
+        return -1; // would not fit in the resident set
+    int head = allocate_run(n);
+    if (head == -1)
+        return -1;
+    auto &pte = proc.page_table.huge_entry(base, level);
+    map_frame(pid, base, pte, head, false, level);
+    pte.dirty = write;
+    huge_faults++;
+    return head;
+}
+
+// khugepaged style collapse: once all 512 base pages of an aligned range are
+// resident they are copied into a fresh aligned run and mapped by one entry
+int VirtualMemory::promote(int pid, Process &proc, uint64_t vpn)
+{
+    const uint64_t n = pages_at_level(HUGE_2M_LEVEL);
+    uint64_t base = vpn & ~(n - 1);
+    if (base + n > proc.num_pages || proc.page_table.mapped_pages(base, HUGE_2M_LEVEL) != n)
+        return -1;
+
+    std::vector<int> sources(n);
+    for (uint64_t i = 0; i < n; i++) {
+        sources[i] = proc.page_table.find(base + i)->frame;
+        if (is_shared(sources[i]))
+            return -1; // other processes still map part of the range
+    }
+    for (int src : sources)
+        pinned[src] = 1; // the run must not be carved out of the pages being copied
+    int head = allocate_run(n);
+    for (int src : sources)
+        pinned[src] = 0;
+    if (head == -1) {
+        thp_failures++;
+        return -1;
+    }
+
+    bool dirty = false;
+    for (uint64_t i = 0; i < n; i++) {
+        auto &old = *proc.page_table.find(base + i);
+        int src = sources[i];
+        physical_memory[head + i].swap(physical_memory[src]);
+        dirty |= old.dirty;
+        old.valid = false;
+        tlb_shootdown(pid, base + i, 1);
+        resident.remove(src);
+        proc.frames.remove(src);
+        proc.resident_pages--;
+        prefetched[src] = Prefetch::NONE;
+        release_frame(src);
+        if (buddy)
+            buddy->deallocate(src);
+    }
+    auto &pte = proc.page_table.huge_entry(base, HUGE_2M_LEVEL);
+    install(pid, base, pte, head, HUGE_2M_LEVEL);
+    pte.dirty = dirty;
+    thp_promotions++;
+    return head;
+}
+
+/* ---------------- SHARING / COPY ON WRITE ---------------- */
+// a frame mapped by more than one pte (or owned by a segment) lists its mappers in
+// sharers; frame_refs counts them. Shared frames are always base pages.
+
+void VirtualMemory::fork(int parent, int child)
+{
+    if (!process(parent) || child < 0)
+        throw std::out_of_range("Invalid PID");
+    if (process(child))
+        throw std::invalid_argument("Child PID already in use");
+    Process &p = *processes[parent];
+    create_process(child, p.num_pages);
+    Process &c = *processes[child];
+    c.huge_regions = p.huge_regions;
+    c.shared_regions = p.shared_regions;
+    c.quota = p.quota;
+    c.priority = p.priority;
+    c.home_node = p.home_node; // runs next to its parent with the same memory policy
+    c.numa_policy = p.numa_policy;
+    c.preferred_node = p.preferred_node;
+    c.interleave_next = p.interleave_next;
+
+    swap.copy_process(parent, child); // pages that are not resident
+    for (int f = p.frames.head; f != -1; f = p.frames.after(f)) {
+        uint64_t vpn = frame_table[f].vpn;
+        if (is_shared(f))
+            for (auto &m : sharers[f])
+                if (m.pid == parent)
+                    vpn = m.vpn;
+        auto &ppte = *p.page_table.find(vpn);
+
+        if (frame_table[f].level > 1) {
+            // huge pages are not shared: the child gets a snapshot in its swap slots
+            if (ppte.dirty)
+                for (uint64_t i = 0; i < pages_at_level(frame_table[f].level); i++)
+                    swap.write(child, vpn + i, physical_memory[f + i].data());
+            continue;
+        }
+
+        if (!is_shared(f))
+            sharers[f] = {{parent, vpn}};
+        sharers[f].push_back({child, vpn});
+        frame_refs[f]++;
+        ppte.cow = true;
+        c.page_table.entry(vpn) = ppte;
+        c.frames.push_back(f);
+        c.resident_pages++;
+    }
+}
+
+void VirtualMemory::map_shared(int pid, uint64_t va, uint64_t length, int segment)
+{
+    if (!process(pid))
+        throw std::out_of_range("Invalid PID");
+    if (segment < 0)
+        throw std::invalid_argument("Segment ids start at 0");
+    Process &proc = *processes[pid];
+    if (length == 0 || va / page_size >= proc.num_pages)
+        throw std::out_of_range("Virtual range outside the process address space");
+    for (auto &r : proc.shared_regions)
+        if (r.segment == segment)
+            throw std::invalid_argument("Segment already mapped by this process");
+    // pages of the range that are already mapped stay private until they are evicted
+    uint64_t first = va / page_size;
+    uint64_t end = std::min((va + length - 1) / page_size + 1, proc.num_pages);
+    proc.shared_regions.push_back({first, end, segment});
+}
+
+const SharedRegion *VirtualMemory::shared_region(const Process &proc, uint64_t vpn) const
+{
+    for (auto &r : proc.shared_regions)
+        if (vpn >= r.first_vpn && vpn < r.end_vpn)
+            return &r;
+    return nullptr;
+}
+
+// fault on a segment page: map the resident copy if there is one, otherwise read it in
+int VirtualMemory::map_segment_page(int pid, Process &proc, uint64_t vpn, PageTableEntry &pte, const SharedRegion &region)
+{
+    SwapKey key = segment_key(region.segment, vpn - region.first_vpn);
+    auto it = segment_frames.find(key);
+    if (it != segment_frames.end()) {
+        int frame = it->second;
+        if (!fit_quota(pid))
+            throw std::runtime_error("No frame can be evicted");
+        shared_faults++;
+        frame_refs[frame]++;
+        sharers[frame].push_back({pid, vpn});
+        proc.frames.push_back(frame);
+        proc.resident_pages++;
+        pte = {true, frame, time, time, true, false, true};
+        referenced(pid, pte, frame, false);
+        return frame;
+    }
+
+    int frame = allocate_frame(pid);
+    if (frame == -1)
+        throw std::runtime_error("No frame can be evicted");
+    page_in(key.pid, key.vpn, frame, 1);
+    install(pid, vpn, pte, frame, 1);
+    pte.cow = true;
+    frame_table[frame].pid = key.pid; // the segment owns the contents
+    frame_table[frame].vpn = key.vpn;
+    sharers[frame] = {{pid, vpn}};
+    segment_frames[key] = frame;
+    return frame;
+}
+
+// first write to a shared page: copy it, or take it over if nobody else maps it any more
+int VirtualMemory::cow_fault(int pid, Process &proc, uint64_t vpn, PageTableEntry &pte)
+{
+    int old = pte.frame;
+    if (!is_shared(old)) {
+        cow_faults++;
+        proc.cow_faults++;
+        pte.cow = false;
+        referenced(pid, pte, old, true);
+        return old;
+    }
+
+    // the copy replaces the shared frame, which does not count against the quota meanwhile
+    pinned[old] = 1;
+    proc.resident_pages--;
+    int frame = allocate_frame(pid);
+    proc.resident_pages++;
+    pinned[old] = 0;
+    if (frame == -1)
+        throw std::runtime_error("No frame can be evicted");
+    cow_faults++;
+    proc.cow_faults++;
+    physical_memory[frame] = physical_memory[old];
+    cow_copies++;
+    fault_cycles += cow_copy_cycles;
+
+    unshare(old, pid, vpn);
+    tlb_shootdown(pid, vpn, 1);
+    install(pid, vpn, pte, frame, 1);
+    pte.dirty = true;
+    if (frame_refs[old] == 0)
+        evict_frame(old); // segment page nobody maps any more
+    return frame;
+}
+
+void VirtualMemory::unshare(int frame, int pid, uint64_t vpn)
+{
+    auto &list = sharers[frame];
+    list.erase(std::find(list.begin(), list.end(), SwapKey{pid, vpn}));
+    frame_refs[frame]--;
+    processes[pid]->frames.remove(frame);
+    processes[pid]->resident_pages--;
+
+    // the last process mapping an anonymous page owns it privately again
+    auto &owner = frame_table[frame];
+    if (frame_refs[frame] == 1 && owner.pid >= 0) {
+        owner.pid = list.front().pid;
+        owner.vpn = list.front().vpn;
+        sharers.erase(frame);
+    }
+}
+
+// eviction of a shared frame unmaps it everywhere; one write covers every mapper
+// whose swap copy is stale, afterwards each process faults in a private copy
+void VirtualMemory::unmap_shared(int frame)
+{
+    bool written = false;
+    for (auto &m : sharers[frame]) {
+        Process &p = *processes[m.pid];
+        auto &pte = *p.page_table.find(m.vpn);
+        if (pte.dirty) {
+            swap.write(m.pid, m.vpn, physical_memory[frame].data());
+            written = true;
+        }
+        pte.valid = false;
+        pte.dirty = false;
+        pte.cow = false;
+        tlb_shootdown(m.pid, m.vpn, 1);
+        p.frames.remove(frame);
+        p.resident_pages--;
+    }
+    if (written) {
+        writebacks++;
+        fault_cycles += transfer_cycles(1);
+    } else {
+        clean_evictions++;
+    }
+    auto &owner = frame_table[frame];
+    if (owner.pid < -1)
+        segment_frames.erase({owner.pid, owner.vpn});
+    sharers.erase(frame);
+}
+
+uint64_t VirtualMemory::frames_saved() const
+{
+    uint64_t n = 0;
+    for (auto &s : sharers)
+        n += s.second.size() - 1;
+    return n;
+}
+
+/* ---------------- RESIDENT SET QUOTAS ---------------- */
+const Process *VirtualMemory::process(int pid) const
+{
+    if (pid < 0 || (size_t)pid >= processes.size())
+        return nullptr;
+    return processes[pid].get();
+}
+
+void VirtualMemory::set_quota(int pid, uint64_t frames)
+{
+    if (!process(pid))
+        throw std::out_of_range("Invalid PID");
+    processes[pid]->quota = frames; // a shrunk quota is enforced on the next fault
+}
+
+void VirtualMemory::set_priority(int pid, unsigned weight)
+{
+    if (!process(pid))
+        throw std::out_of_range("Invalid PID");
+    processes[pid]->priority = weight;
+}
+
+// split all frames by a per-process weight, every process keeps at least one frame
+void VirtualMemory::allocate_frames(FrameAllocation mode)
+{
+    auto weight = [&](const Process &p) -> double {
+        if (mode == FrameAllocation::PROPORTIONAL)
+            return (double)p.num_pages;
+        if (mode == FrameAllocation::PRIORITY)
+            return p.priority;
+        return 1.0;
+    };
+    double total = 0;
+    for (auto &p : processes)
+        if (p)
+            total += weight(*p);
+    for (auto &p : processes) {
+        if (!p)
+            continue;
+        if (mode == FrameAllocation::NONE || total == 0)
+            p->quota = 0;
+        else
+            p->quota = std::max<uint64_t>(1, (uint64_t)(num_frames * weight(*p) / total));
+    }
+}
+
+size_t VirtualMemory::huge_pages_resident(int level) const
+{
+    size_t n = 0;
+    for (int f = resident.head; f != -1; f = resident.next[f])
+        if (frame_table[f].level == level)
+            n++;
+    return n;
+}
+
+/* ---------------- READAHEAD ---------------- */
+void VirtualMemory::set_readahead(size_t min_pages, size_t max_pages)
+{
+    readahead_max = max_pages;
+    readahead_min = std::min(std::max<size_t>(min_pages, 1), max_pages);
+    readahead_window = readahead_min;
+}
+
+// map the pages following a fault in the same swap request; sequential faults grow the window
+void VirtualMemory::readahead(int pid, Process &proc, uint64_t vpn, int demand_frame)
+{
+    if (vpn == proc.readahead_next)
+        readahead_window = std::min(readahead_max, readahead_window * 2);
+
+    size_t i = 1;
+    for (; i <= readahead_window && vpn + i < proc.num_pages; i++) {
+        if (huge_level(proc, vpn + i) > 1 || shared_region(proc, vpn + i))
+            break; // left to its own huge page / shared segment fault
+        auto &pte = proc.page_table.entry(vpn + i);
+        if (pte.valid)
+            continue;
+        int frame = allocate_frame(pid, demand_frame);
+        if (frame == -1)
+            break; // would throw out the page we just faulted in
+
+        map_frame(pid, vpn + i, pte, frame, true);
+        pte.ref_bit = false; // not referenced yet
+        pte.dirty = false;
+        age[frame] = 0;
+        readahead_pages++;
+    }
+    proc.readahead_next = vpn + i;
+}
+
+size_t VirtualMemory::resident_bytes() const
+{
+    size_t n = 0;
+    for (auto &f : physical_memory)
+        n += f.size();
+    return n;
+}
+
+uint64_t VirtualMemory::translate(int pid, uint64_t va, bool write) // proces id , virtual memory
+{
+    SIM_PROFILE(TRANSLATE);
+    uint64_t start = cycles();
+    uint64_t fault_start = fault_cycles;
+    uint64_t pa = translate_page(pid, va, write);
+    if (numa) {
+        // count the reference as local or remote, the page may move to this process' node
+        uint64_t vpn = va / page_size;
+        int frame = (int)(pa / page_size);
+        int moved = numa_reference(pid, *processes[pid], vpn, frame);
+        if (moved != frame)
+            tlb_fill(pid, vpn, moved, 1);
+        pa = (uint64_t)moved * page_size + pa % page_size;
+    }
+    translate_latency.record(cycles() - start);
+    if (fault_cycles != fault_start)
+        fault_latency.record(fault_cycles - fault_start);
+    return pa;
+}
+
+void VirtualMemory::register_stats(StatsRegistry &stats, const std::string &prefix) const
+{
+    stats.counter(prefix + ".page_hits", &page_hits);
+    stats.counter(prefix + ".page_faults", &page_faults);
+    stats.counter(prefix + ".major_faults", &major_faults);
+    stats.counter(prefix + ".writebacks", &writebacks);
+    stats.counter(prefix + ".clean_evictions", &clean_evictions);
+    stats.counter(prefix + ".translation_cycles", &translation_cycles);
+    stats.counter(prefix + ".page_walks", &page_walks);
+    stats.counter(prefix + ".walk_cycles", &walk_cycles);
+    stats.counter(prefix + ".fault_cycles", &fault_cycles);
+    stats.counter(prefix + ".readahead_pages", &readahead_pages);
+    stats.counter(prefix + ".readahead_hits", &readahead_hits);
+    stats.counter(prefix + ".huge_faults", &huge_faults);
+    stats.counter(prefix + ".thp_promotions", &thp_promotions);
+    stats.counter(prefix + ".cow_faults", &cow_faults);
+    stats.counter(prefix + ".shared_faults", &shared_faults);
+    if (numa) {
+        stats.counter(prefix + ".numa_migrations", &numa_migrations);
+        stats.counter(prefix + ".numa_fallbacks", &numa_fallbacks);
+    }
+    if (l1_tlb) {
+        stats.counter(prefix + ".dtlb.hits", &l1_tlb->hits);
+        stats.counter(prefix + ".dtlb.misses", &l1_tlb->misses);
+        stats.counter(prefix + ".stlb.hits", &l2_tlb->hits);
+        stats.counter(prefix + ".stlb.misses", &l2_tlb->misses);
+    }
+    stats.gauge(prefix + ".resident_bytes", [this]() { return (double)resident_bytes(); });
+    stats.gauge(prefix + ".page_table_bytes", [this]() { return (double)page_table_bytes(); });
+    stats.histogram(prefix + ".translate_latency", &translate_latency);
+    stats.histogram(prefix + ".fault_latency", &fault_latency);
+    if (buddy)
+        buddy->register_stats(stats, prefix + ".frames");
+}
+
+uint64_t VirtualMemory::translate_page(int pid, uint64_t va, bool write)
+{
+    time++;
+    if (policy == PageReplacement::AGING && time % aging_interval == 0)
+        aging_tick();
+    if (policy == PageReplacement::OPT) {
+        current_next_use = opt_position < future_next_use.size() ? future_next_use[opt_position] : OPT_NEVER;
+        opt_position++;
+    }
+
+    if (pid < 0 || (size_t)pid >= processes.size() || !processes[pid])
+        throw std::out_of_range("Invalid PID");
+    Process &proc = *processes[pid];
+    uint64_t vpn = va / page_size;
+    size_t offset = va % page_size;
+    if (vpn >= proc.num_pages)
+        throw std::out_of_range("Virtual address outside the process address space");
+
+    // TLB: dTLB, then STLB, then a page walk
+    if (l1_tlb) {
+        if (!tlb_asid && pid != last_pid && last_pid != -1) {
+            l1_tlb->flush();
+            l2_tlb->flush();
+            tlb_flushes++;
+        }
+        last_pid = pid;
+
+        int frame;
+        bool hit = false;
+        if (l1_tlb->lookup(tlb_asid_of(pid), vpn, frame)) {
+            translation_cycles += l1_tlb->hit_cost();
+            hit = true;
+        } else {
+            translation_cycles += l1_tlb->miss_cost();
+            if (l2_tlb->lookup(tlb_asid_of(pid), vpn, frame)) {
+                translation_cycles += l2_tlb->hit_cost();
+                // refill from this process' mapping, a shared frame's owner may map another vpn
+                int level;
+                auto *pte = proc.page_table.find(vpn, level);
+                if (pte && pte->valid)
+                    l1_tlb->insert(tlb_asid_of(pid), vpn & ~(pages_at_level(level) - 1), pte->frame, level);
+                hit = true;
+            } else {
+                translation_cycles += l2_tlb->miss_cost();
+            }
+        }
 
-    frame_table[frame] = {pid, (int)vpn};
+        // the replacement policy still needs to see the reference,
+        // a write to a copy-on-write page traps and is handled after the walk
+        auto *cached = hit ? proc.page_table.find(vpn) : nullptr;
+        if (cached && !(write && cached->cow)) {
+            page_hits++;
+            proc.hits++;
+            referenced(pid, *cached, frame_table[frame].head, write);
+            return (uint64_t)frame * page_size + offset;
+        }
+    }
+
+    uint64_t levels_before = proc.page_table.walk_levels;
+    int level;
+    auto &pte = proc.page_table.lookup(vpn, level); // this is page table entry of the chosen page id
+    if (l1_tlb) {
+        uint64_t cycles = (proc.page_table.walk_levels - levels_before) * walk_latency;
+        page_walks++;
+        walk_cycles += cycles;
+        translation_cycles += cycles;
+    }
+
+    // PAGE HIT
+    if (pte.valid) {
+        if (write && pte.cow) {
+            int frame = cow_fault(pid, proc, vpn, pte);
+            tlb_fill(pid, vpn, frame, 1);
+            return (uint64_t)frame * page_size + offset;
+        }
+        uint64_t base = vpn & ~(pages_at_level(level) - 1);
+        page_hits++;
+        proc.hits++;
+        referenced(pid, pte, pte.frame, write);
+        tlb_fill(pid, base, pte.frame, level);
+        return (uint64_t)(pte.frame + (vpn - base)) * page_size + offset;
+    }
+
+    // PAGE FAULT
+    page_faults++;
+    proc.faults++;
+    SIM_EVENT(PAGE_FAULT, 0, vpn, pid);
+
+    // shared segment: reuse the frame if another process has the page resident
+    if (const SharedRegion *region = shared_region(proc, vpn)) {
+        int frame = map_segment_page(pid, proc, vpn, pte, *region);
+        if (write)
+            frame = cow_fault(pid, proc, vpn, pte);
+        tlb_fill(pid, vpn, frame, 1);
+        return (uint64_t)frame * page_size + offset;
+    }
+
+    // inside a huge page region the whole page comes in with this fault
+    int want = policy == PageReplacement::OPT ? 1 : huge_level(proc, vpn);
+    if (want > 1) {
+        int head = map_huge_page(pid, proc, vpn, want, write);
+        if (head != -1) {
+            uint64_t base = vpn & ~(pages_at_level(want) - 1);
+            tlb_fill(pid, base, head, want);
+            return (uint64_t)(head + (vpn - base)) * page_size + offset;
+        }
+        huge_fallbacks++; // range partly mapped with base pages, or no run could be freed
+    }
+
+    int frame = allocate_frame(pid);
+    if (frame == -1)
+        throw std::runtime_error("No frame can be evicted");
+    map_frame(pid, vpn, pte, frame);
+    pte.dirty = write;
+    if (readahead_max > 0 && policy != PageReplacement::OPT)
+        readahead(pid, proc, vpn, frame);
+
+    if (thp && policy != PageReplacement::OPT) {
+        int head = promote(pid, proc, vpn); // pte is freed if this succeeds
+        if (head != -1) {
+            uint64_t base = vpn & ~(pages_at_level(HUGE_2M_LEVEL) - 1);
+            tlb_fill(pid, base, head, HUGE_2M_LEVEL);
+            return (uint64_t)(head + (vpn - base)) * page_size + offset;
+        }
+    }
+    tlb_fill(pid, vpn, frame, 1);
 
     return (uint64_t)frame * page_size + offset;
 }
+
+/* ---------------- CHECKPOINT ---------------- */
+
+// a list is saved as its order from head to tail
+template <class List>
+static void save_list(CheckpointWriter &out, const List &list)
+{
+    out.put(list.count);
+    for (int f = list.head; f != -1; f = list.after(f))
+        out.put(f);
+}
+
+// list has to be empty
+template <class List>
+static void load_list(CheckpointReader &in, List &list, size_t frames)
+{
+    uint64_t n = in.get_below(frames + 1, "frame list length");
+    for (uint64_t i = 0; i < n; i++) {
+        int f = (int)in.get_below(frames, "frame number");
+        if (list.contains(f))
+            throw std::runtime_error("Checkpoint holds a frame twice in a list");
+        list.push_back(f);
+    }
+}
+
+static void save_tlb(CheckpointWriter &out, const TLB *tlb)
+{
+    out.put_bool(tlb != nullptr);
+    if (tlb)
+        tlb->checkpoint(out);
+}
+
+static void load_tlb(CheckpointReader &in, TLB *tlb)
+{
+    if (in.get_bool() != (tlb != nullptr))
+        throw std::runtime_error("Checkpoint TLB configuration differs");
+    if (tlb)
+        tlb->restore(in);
+}
+
+void VirtualMemory::checkpoint(CheckpointWriter &out)
+{
+    if (policy == PageReplacement::OPT || buddy || numa || !sharers.empty() || !segment_frames.empty())
+        throw std::runtime_error("Checkpoints do not support OPT, buddy frames, NUMA or shared pages");
+    for (auto &p : processes)
+        if (p && !p->shared_regions.empty())
+            throw std::runtime_error("Checkpoints do not support shared segments");
+
+    out.begin("VMEM");
+    out.put(page_size);
+    out.put(num_frames);
+    out.put((uint64_t)policy);
+    out.put(time);
+    out.put(clock_hand);
+    out.put_signed(last_pid);
+    out.put(readahead_window);
+
+    out.put(processes.size());
+    for (auto &p : processes) {
+        out.put_bool(p != nullptr);
+        if (!p)
+            continue;
+        out.put(p->num_pages);
+        out.put(p->readahead_next);
+        out.put(p->huge_regions.size());
+        for (const HugeRegion &r : p->huge_regions) {
+            out.put(r.first_vpn);
+            out.put(r.end_vpn);
+            out.put(r.level);
+        }
+        out.put(p->resident_pages);
+        out.put(p->quota);
+        out.put(p->priority);
+        out.put(p->faults);
+        out.put(p->hits);
+        out.put(p->cow_faults);
+        p->page_table.checkpoint(out);
+        save_list(out, p->frames);
+    }
+
+    for (size_t f = 0; f < num_frames; f++) {
+        const FrameInfo &info = frame_table[f];
+        out.put_signed(info.pid);
+        out.put(info.vpn);
+        out.put(info.level);
+        out.put(info.head);
+        out.put(frame_refs[f]);
+        out.put(age[f]);
+        out.put((uint64_t)prefetched[f]);
+        // contents, if the frame was ever paged in
+        const std::vector<uint8_t> &data = physical_memory[f];
+        bool zero = std::all_of(data.begin(), data.end(), [](uint8_t b) { return b == 0; });
+        out.put(data.empty() ? 0 : zero ? 1 : 2);
+        if (!zero)
+            out.put_bytes(data.data(), page_size);
+    }
+    out.put(free_in_block.size());
+    for (uint32_t n : free_in_block)
+        out.put(n);
+    save_list(out, free_list);
+    save_list(out, resident);
+
+    swap.checkpoint(out);
+    save_tlb(out, l1_tlb.get());
+    save_tlb(out, l2_tlb.get());
+
+    for (uint64_t c : {(uint64_t)page_hits, (uint64_t)page_faults, translation_cycles, page_walks, walk_cycles,
+                       tlb_flushes, fault_cycles, major_faults, writebacks, clean_evictions, readahead_pages,
+                       readahead_hits, readahead_wasted, huge_faults, huge_fallbacks, thp_promotions, thp_failures,
+                       cow_faults, cow_copies, shared_faults})
+        out.put(c);
+    out.put_signed(readahead_saved_cycles);
+    translate_latency.checkpoint(out);
+    fault_latency.checkpoint(out);
+    out.end();
+}
+
+void VirtualMemory::restore(CheckpointReader &in)
+{
+    if (time != 0 || free_list.count != num_frames || swap.pages() != 0)
+        throw std::runtime_error("Checkpoints restore only into a VM that has not run yet");
+    if (policy == PageReplacement::OPT || buddy || numa)
+        throw std::runtime_error("Checkpoints do not support OPT, buddy frames or NUMA");
+
+    in.begin("VMEM");
+    if (in.get() != page_size || in.get() != num_frames)
+        throw std::runtime_error("Checkpoint VM has a different page size or frame count");
+    if (in.get() != (uint64_t)policy)
+        throw std::runtime_error("Checkpoint VM uses a different replacement policy");
+    time = in.get();
+    clock_hand = in.get_below(num_frames, "clock hand");
+    last_pid = (int)in.get_signed();
+    readahead_window = std::min<uint64_t>(std::max<uint64_t>(in.get(), readahead_min), readahead_max);
+
+    uint64_t pids = in.get_below((uint64_t)VM_MAX_PID + 2, "process count");
+    for (uint64_t pid = 0; pid < pids; pid++) {
+        if (!in.get_bool())
+            continue;
+        uint64_t pages = in.get();
+        create_process((int)pid, pages); // replaces a process the caller set up
+        Process &p = *processes[pid];
+        p.readahead_next = in.get();
+        uint64_t regions = in.get_below(pages + 1, "huge region count");
+        for (uint64_t i = 0; i < regions; i++) {
+            HugeRegion r;
+            r.first_vpn = in.get();
+            r.end_vpn = in.get();
+            r.level = (int)in.get_below(PT_LEVELS + 1, "page level");
+            p.huge_regions.push_back(r);
+        }
+        p.resident_pages = in.get();
+        p.quota = in.get();
+        p.priority = (unsigned)in.get();
+        p.faults = in.get();
+        p.hits = in.get();
+        p.cow_faults = in.get();
+        p.page_table.restore(in, num_frames);
+        load_list(in, p.frames, num_frames);
+    }
+
+    for (size_t f = 0; f < num_frames; f++) {
+        FrameInfo &info = frame_table[f];
+        info.pid = (int)in.get_signed();
+        info.vpn = in.get();
+        info.level = (int)in.get_below(PT_LEVELS + 1, "page level");
+        info.head = (int)in.get_below(num_frames, "frame number");
+        if (info.pid < -1 || info.pid >= (int)processes.size() || (info.pid >= 0 && !processes[info.pid]))
+            throw std::runtime_error("Checkpoint frame belongs to no process");
+        frame_refs[f] = (uint32_t)in.get();
+        age[f] = (uint8_t)in.get();
+        prefetched[f] = (Prefetch)in.get_below((uint64_t)Prefetch::SWAPPED + 1, "prefetch state");
+        uint64_t contents = in.get_below(3, "frame contents");
+        physical_memory[f].clear();
+        if (contents != 0)
+            physical_memory[f].assign(page_size, 0);
+        if (contents == 2)
+            in.get_bytes(physical_memory[f].data(), page_size);
+    }
+    if (in.get() != free_in_block.size())
+        throw std::runtime_error("Checkpoint VM has a different block count");
+    for (uint32_t &n : free_in_block)
+        n = (uint32_t)in.get_below(pages_at_level(HUGE_2M_LEVEL) + 1, "free frame count");
+    free_list.init(num_frames);
+    load_list(in, free_list, num_frames);
+    resident.init(num_frames);
+    load_list(in, resident, num_frames);
+
+    swap.restore(in);
+    load_tlb(in, l1_tlb.get());
+    load_tlb(in, l2_tlb.get());
+
+    for (size_t *c : {&page_hits, &page_faults})
+        *c = in.get();
+    for (uint64_t *c : {&translation_cycles, &page_walks, &walk_cycles, &tlb_flushes, &fault_cycles, &major_faults,
+                        &writebacks, &clean_evictions, &readahead_pages, &readahead_hits, &readahead_wasted,
+                        &huge_faults, &huge_fallbacks, &thp_promotions, &thp_failures, &cow_faults, &cow_copies,
+                        &shared_faults})
+        *c = in.get();
+    readahead_saved_cycles = in.get_signed();
+    translate_latency.restore(in);
+    fault_latency.restore(in);
+    in.end();
+}
@@ -0,0 +1,254 @@
+#include "include/workload.h"
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+
+const uint64_t WORD = 8;
+const uint64_t LINE = 64;
+
+/* ---------------- ADDRESS STREAMS ---------------- */
+
+AddressWorkload default_address_workload()
+{
+    AddressWorkload w;
+    w.pattern = AddressPattern::UNIFORM;
+    w.count = 1000000;
+    w.footprint = 1 << 20;
+    w.stride = 64;
+    w.zipf_theta = 0.99;
+    w.hot_bytes = 64 * 1024;
+    w.phase_length = 100000;
+    w.write_ratio = 0.3;
+    w.processes = 1;
+    w.seed = 1;
+    return w;
+}
+
+AddressGenerator::AddressGenerator(const AddressWorkload &workload)
+    : w(workload),
+      rng(workload.seed)
+{
+    if (w.footprint < LINE)
+        throw std::invalid_argument("footprint must be at least one cache line");
+    if (w.processes == 0)
+        throw std::invalid_argument("processes must not be 0");
+    if (w.write_ratio < 0 || w.write_ratio > 1)
+        throw std::invalid_argument("write_ratio must be between 0 and 1");
+    lines = w.footprint / LINE;
+    write_threshold = w.write_ratio >= 1 ? UINT64_MAX : (uint64_t)std::ldexp(w.write_ratio, 64);
+
+    if (w.pattern == AddressPattern::STRIDED && w.stride == 0)
+        throw std::invalid_argument("stride must not be 0");
+    if (w.pattern == AddressPattern::ZIPF) {
+        if (!(w.zipf_theta > 0 && w.zipf_theta < 1))
+            throw std::invalid_argument("zipf_theta must be between 0 and 1 (exclusive)");
+        double zeta2 = 1 + std::pow(0.5, w.zipf_theta);
+        zipf_zetan = 0;
+        for (uint64_t i = 1; i <= lines; i++)
+            zipf_zetan += std::pow((double)i, -w.zipf_theta);
+        zipf_alpha = 1 / (1 - w.zipf_theta);
+        zipf_eta = (1 - std::pow(2.0 / lines, 1 - w.zipf_theta)) / (1 - zeta2 / zipf_zetan);
+    }
+    if (w.pattern == AddressPattern::PHASED) {
+        if (w.hot_bytes < LINE || w.hot_bytes > w.footprint)
+            throw std::invalid_argument("hot_bytes must be between one cache line and the footprint");
+        if (w.phase_length == 0)
+            throw std::invalid_argument("phase_length must not be 0");
+    }
+    if (w.pattern == AddressPattern::POINTER_CHASE) {
+        // Sattolo's shuffle: a single cycle through every line
+        chase.resize(lines);
+        for (uint64_t i = 0; i < lines; i++)
+            chase[i] = i;
+        for (uint64_t i = lines - 1; i > 0; i--)
+            std::swap(chase[i], chase[rng.below(i)]);
+    }
+    rewind();
+}
+
+void AddressGenerator::rewind()
+{
+    // the chase cycle was drawn from the seed once, the stream restarts after it
+    rng = SplitMix64(w.seed ^ 0x5bd1e995);
+    produced = 0;
+    offset = 0;
+    window = 0;
+}
+
+uint64_t AddressGenerator::zipf_line()
+{
+    double u = rng.uniform();
+    double uz = u * zipf_zetan;
+    if (uz < 1)
+        return 0;
+    if (uz < 1 + std::pow(0.5, w.zipf_theta))
+        return 1;
+    uint64_t line = (uint64_t)(lines * std::pow(zipf_eta * u - zipf_eta + 1, zipf_alpha));
+    return std::min(line, lines - 1);
+}
+
+bool AddressGenerator::next(TraceRecord &r)
+{
+    if (produced == w.count)
+        return false;
+    uint64_t addr = 0;
+    switch (w.pattern) {
+    case AddressPattern::SEQUENTIAL:
+        addr = offset;
+        offset += WORD;
+        if (offset >= w.footprint)
+            offset = 0;
+        break;
+    case AddressPattern::STRIDED:
+        addr = offset;
+        offset += w.stride;
+        if (offset >= w.footprint)
+            offset %= w.footprint;
+        break;
+    case AddressPattern::UNIFORM:
+        addr = rng.below(w.footprint / WORD) * WORD;
+        break;
+    case AddressPattern::ZIPF:
+        addr = zipf_line() * LINE + rng.below(LINE / WORD) * WORD;
+        break;
+    case AddressPattern::POINTER_CHASE:
+        addr = offset * LINE;
+        offset = chase[offset];
+        break;
+    case AddressPattern::PHASED:
+        if (produced % w.phase_length == 0)
+            window = rng.below((w.footprint - w.hot_bytes) / LINE + 1) * LINE;
+        addr = window + rng.below(w.hot_bytes / WORD) * WORD;
+        break;
+    }
+    r.op = rng.next() < write_threshold ? TraceOp::WRITE : TraceOp::READ;
+    r.pid = (int)(produced % w.processes);
+    r.addr = addr;
+    r.size = WORD;
+    produced++;
+    return true;
+}
+
+/* ---------------- ALLOCATION STREAMS ---------------- */
+
+AllocationWorkload default_allocation_workload()
+{
+    AllocationWorkload w;
+    w.count = 1000000;
+    w.sizes = SizeDistribution::EXPONENTIAL;
+    w.min_size = 16;
+    w.max_size = 64 * 1024;
+    w.mean_size = 256;
+    w.lifetime = LifetimeModel::EXPONENTIAL;
+    w.live = 1000;
+    w.mean_lifetime = 1000;
+    w.seed = 1;
+    return w;
+}
+
+AllocationGenerator::AllocationGenerator(const AllocationWorkload &workload)
+    : w(workload),
+      rng(workload.seed)
+{
+    if (w.min_size == 0 || w.max_size < w.min_size)
+        throw std::invalid_argument("sizes need 0 < min_size <= max_size");
+    if (w.sizes == SizeDistribution::EXPONENTIAL && !(w.mean_size >= w.min_size))
+        throw std::invalid_argument("mean_size must be at least min_size");
+    if (w.lifetime == LifetimeModel::EXPONENTIAL && !(w.mean_lifetime > 0))
+        throw std::invalid_argument("mean_lifetime must be positive");
+    if (w.lifetime != LifetimeModel::EXPONENTIAL && w.live == 0)
+        throw std::invalid_argument("live must not be 0");
+    rewind();
+}
+
+void AllocationGenerator::rewind()
+{
+    rng = SplitMix64(w.seed);
+    produced = 0;
+    next_id = 0;
+    live.clear();
+    deaths = decltype(deaths)();
+}
+
+uint32_t AllocationGenerator::next_size()
+{
+    uint64_t size = w.min_size;
+    switch (w.sizes) {
+    case SizeDistribution::FIXED:
+        break;
+    case SizeDistribution::UNIFORM:
+        size = w.min_size + rng.below((uint64_t)w.max_size - w.min_size + 1);
+        break;
+    case SizeDistribution::EXPONENTIAL:
+        size = w.min_size + (uint64_t)(-std::log(1 - rng.uniform()) * (w.mean_size - w.min_size));
+        break;
+    case SizeDistribution::BIMODAL:
+        if (rng.below(10) != 0)
+            size = w.min_size + rng.below((uint64_t)w.min_size + 1);
+        else
+            size = w.max_size / 2 + rng.below((uint64_t)w.max_size - w.max_size / 2 + 1);
+        break;
+    }
+    return (uint32_t)std::min(std::max(size, (uint64_t)w.min_size), (uint64_t)w.max_size);
+}
+
+bool AllocationGenerator::free_one(uint64_t &id)
+{
+    if (w.lifetime == LifetimeModel::EXPONENTIAL) {
+        // the clock is the number of allocations made so far
+        if (deaths.empty() || deaths.top().when > next_id)
+            return false;
+        id = deaths.top().id;
+        deaths.pop();
+        return true;
+    }
+    if (live.empty())
+        return false;
+    // hover around the live target: mostly allocate below it, mostly free above it
+    bool below = live.size() < w.live;
+    if (below ? rng.below(4) != 0 : rng.below(4) == 0)
+        return false;
+    switch (w.lifetime) {
+    case LifetimeModel::FIFO:
+        id = live.front();
+        live.pop_front();
+        break;
+    case LifetimeModel::LIFO:
+        id = live.back();
+        live.pop_back();
+        break;
+    default: {
+        size_t i = rng.below(live.size());
+        id = live[i];
+        live[i] = live.back();
+        live.pop_back();
+        break;
+    }
+    }
+    return true;
+}
+
+bool AllocationGenerator::next(TraceRecord &r)
+{
+    if (produced == w.count)
+        return false;
+    uint64_t id;
+    r.pid = 0;
+    if (free_one(id)) {
+        r.op = TraceOp::FREE;
+        r.addr = id;
+        r.size = 0;
+    }
+    else {
+        id = next_id++;
+        r.op = TraceOp::ALLOC;
+        r.addr = id;
+        r.size = next_size();
+        if (w.lifetime == LifetimeModel::EXPONENTIAL)
+            deaths.push({next_id + (uint64_t)(-std::log(1 - rng.uniform()) * w.mean_lifetime), id});
+        else
+            live.push_back(id);
+    }
+    produced++;
+    return true;
+}